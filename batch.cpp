@@ -0,0 +1,443 @@
+/*
+ * batch.cpp
+ */
+
+#include "batch.h"
+#include "binding.h"
+#include <algorithm>
+using namespace std;
+
+void Column::ToVals() {
+	if (!IsInt())
+		return;
+	vals.reserve(ints.size());
+	for (int i : ints)
+		vals.push_back(Val(i));
+	ints.clear();
+}
+
+// a Val that no let has set
+static bool Unset(const Val& v) {
+	return !v.isInt() && !v.isStr() && !v.isErr();
+}
+
+// goes back to an int array if every row is an int
+static void Narrow(Column& c) {
+	if (c.IsInt())
+		return;
+	for (const Val& v : c.vals)
+		if (!v.isInt())
+			return;
+	c.ints.reserve(c.vals.size());
+	for (const Val& v : c.vals)
+		c.ints.push_back(v.ValInt());
+	c.vals.clear();
+}
+
+// a column whose rows are all v
+static Column Fill(size_t rows, const Val& v) {
+	Column c;
+	if (v.isInt())
+		c.ints.assign(rows, v.ValInt());
+	else
+		c.vals.assign(rows, v);
+	return c;
+}
+
+Batch::Batch(size_t rows, const SnapshotRef& base) : base(base), alive(rows, 1), rows(rows), out(rows) {}
+
+Mask Batch::Running(const Mask& mask) const {
+	Mask m(rows);
+	for (size_t r = 0; r < rows; r++)
+		m[r] = mask[r] & alive[r];
+	return m;
+}
+
+bool Batch::Any(const Mask& mask) const {
+	for (unsigned char m : mask)
+		if (m)
+			return true;
+	return false;
+}
+
+void Batch::Fail(size_t r, const Val& err) {
+	alive[r] = 0;
+	out[r] += err.RuntimeError() + "\n";
+}
+
+// stops every row of mask with err
+static void FailAll(Batch& batch, const Mask& mask, const Val& err) {
+	for (size_t r = 0; r < batch.rows; r++)
+		if (mask[r])
+			batch.Fail(r, err);
+}
+
+// Keeps the rows of mask whose condition is a nonzero int.  A row whose
+// condition is a string or an error stops, as Loop::Test and If::Test do.
+static void TestRows(Batch& batch, Mask& mask, const Column& cond, ErrCode notInt, int line) {
+	if (cond.IsInt()) {
+		const vector<int>& ints = cond.Ints();
+		for (size_t r = 0; r < batch.rows; r++)
+			mask[r] &= (ints[r] != 0);
+		return;
+	}
+	for (size_t r = 0; r < batch.rows; r++) {
+		if (!mask[r])
+			continue;
+		const Val& v = cond.Vals()[r];
+		if (v.isInt())
+			mask[r] = (v.ValInt() != 0);
+		else {
+			Val err = v.isErr() ? v : Val(notInt);
+			batch.Fail(r, err.At(line));
+			mask[r] = 0;
+		}
+	}
+}
+
+// The int kernels.  Every row is computed, running or not, so the loops
+// have no branches: a choice between two values is made with a mask (see
+// Select), and arithmetic is done unsigned so that a row holding garbage
+// cannot overflow.  Each kernel runs in blocks of LANES rows, a loop GCC
+// vectorizes at -O2 (check with -fopt-info-vec), then the rows left over
+// one at a time.
+
+static const size_t LANES = 8;
+
+// d[i] = op(a[i], b[i]) for each i below n
+template <class Op>
+static inline void Lanes(const int *__restrict a, const int *__restrict b, int *__restrict d, size_t n, Op op) {
+	size_t i = 0;
+	for (; i + LANES <= n; i += LANES)
+		for (size_t j = i; j < i + LANES; j++)
+			d[j] = op(a[j], b[j]);
+	for (; i < n; i++)
+		d[i] = op(a[i], b[i]);
+}
+
+// x if cond is 1, y if it is 0
+static inline int Select(int cond, int x, int y) {
+	int m = -cond;
+	return (x & m) | (y & ~m);
+}
+
+static void AddInts(const int *a, const int *b, int *d, size_t n) {
+	Lanes(a, b, d, n, [](int x, int y) { return (int)((unsigned)x + (unsigned)y); });
+}
+
+static void SubtractInts(const int *a, const int *b, int *d, size_t n) {
+	Lanes(a, b, d, n, [](int x, int y) { return (int)((unsigned)x - (unsigned)y); });
+}
+
+static void MultiplyInts(const int *a, const int *b, int *d, size_t n) {
+	Lanes(a, b, d, n, [](int x, int y) { return (int)((unsigned)x * (unsigned)y); });
+}
+
+// The caller deals with running rows that divide by zero.  The quotient
+// of two ints is exact in a double, and x86 has no vector int divide; a
+// divisor of -1 (which can overflow) divides by 1 and negates.
+static void DivideInts(const int *a, const int *b, int *d, size_t n) {
+	Lanes(a, b, d, n, [](int x, int y) {
+		int q = y + (y == 0);
+		int neg = (q == -1);
+		unsigned r = (unsigned)(int)((double)x / (double)(q + 2 * neg));
+		return (int)((r ^ (unsigned)-neg) + (unsigned)neg);
+	});
+}
+
+// ReverseDigits a digit at a time across the rows: each pass moves the
+// last digit of every v onto the end of d
+static inline void ReverseStep(int& v, int& d) {
+	d = Select(v != 0, (int)((unsigned)d * 10 + (unsigned)(v % 10)), d);
+	v /= 10;
+}
+
+// v is a copy of the ints to reverse, and is used up.  Inlined into its
+// caller, GCC loses the __restrict on the loop nest and does not vectorize it.
+__attribute__((noinline)) static void ReverseInts(int *__restrict v, int *__restrict d, size_t n) {
+	fill(d, d + n, 0);
+	size_t i = 0;
+	for (; i + LANES <= n; i += LANES)
+		for (int k = 0; k < 10; k++)
+			for (size_t j = i; j < i + LANES; j++)
+				ReverseStep(v[j], d[j]);
+	for (; i < n; i++)
+		for (int k = 0; k < 10; k++)
+			ReverseStep(v[i], d[i]);
+}
+
+// sets d to s in the rows of mask k
+static void MergeInts(const int *__restrict s, const unsigned char *__restrict k, int *__restrict d, size_t n) {
+	size_t i = 0;
+	for (; i + LANES <= n; i += LANES)
+		for (size_t j = i; j < i + LANES; j++)
+			d[j] = Select(k[j] != 0, s[j], d[j]);
+	for (; i < n; i++)
+		d[i] = Select(k[i] != 0, s[i], d[i]);
+}
+
+template <class Kernel>
+static Column Ints(const Column& L, const Column& R, Kernel kernel) {
+	Column c;
+	c.ints.resize(L.Ints().size());
+	kernel(L.Ints().data(), R.Ints().data(), c.ints.data(), c.ints.size());
+	return c;
+}
+
+// applies op to the running rows one Val at a time, giving errors the line
+template <class Op>
+static Column EachRow(Batch& batch, const Mask& mask, int line, Op op) {
+	Column c;
+	c.vals.resize(batch.rows);
+	for (size_t r = 0; r < batch.rows; r++) {
+		if (!mask[r])
+			continue;
+		Val v = op(r);
+		if (v.isErr())
+			v.At(line);
+		c.vals[r] = v;
+	}
+	return c;
+}
+
+Column StmtList::EvalBatch(Batch& batch, const Mask& mask) {
+	for (ParseTree *list = this; list != 0; list = list->Right()) {
+		Mask m = batch.Running(mask);
+		if (!batch.Any(m))
+			break;
+		if (!budget->Tick()) {
+			FailAll(batch, m, Val(budget->Reason()).At(list->Left()->GetLineNumber()));
+			break;
+		}
+		list->Left()->EvalBatch(batch, m);
+	}
+	return Column();
+}
+
+Column Let::EvalBatch(Batch& batch, const Mask& mask) {
+	Column L = left->EvalBatch(batch, mask);
+	Mask m = mask;
+	if (!L.IsInt()) {
+		for (size_t r = 0; r < batch.rows; r++) {
+			if (m[r] && L.Vals()[r].isErr()) {
+				batch.Fail(r, L.Vals()[r]);
+				m[r] = 0;
+			}
+		}
+	}
+
+	map<string,Column>::iterator it = batch.vars.find(*id);
+	if (it == batch.vars.end()) {
+		bool every = find(m.begin(), m.end(), 0) == m.end();
+		if (every && L.IsInt()) {
+			Column& var = batch.vars[*id];
+			if (L.IsView())
+				var.ints = L.Ints();
+			else
+				var = std::move(L);
+			return Column();
+		}
+		it = batch.vars.insert(make_pair(*id, Fill(batch.rows, Val()))).first;
+	}
+
+	Column& var = it->second;
+	if (var.IsInt() && L.IsInt()) {
+		// a let of a variable to itself (a view of its own ints) changes nothing
+		if (L.Ints().data() != var.ints.data())
+			MergeInts(L.Ints().data(), m.data(), var.ints.data(), batch.rows);
+	}
+	else {
+		var.ToVals();
+		for (size_t r = 0; r < batch.rows; r++)
+			if (m[r])
+				var.vals[r] = L.Get(r).Keep();
+		Narrow(var);
+	}
+	scratch.Reset();
+	return Column();
+}
+
+Column Print::EvalBatch(Batch& batch, const Mask& mask) {
+	Column L = left->EvalBatch(batch, mask);
+	for (size_t r = 0; r < batch.rows; r++) {
+		if (!mask[r])
+			continue;
+		if (L.IsInt()) {
+			batch.out[r] += to_string(L.Ints()[r]);
+			continue;
+		}
+		const Val& v = L.Vals()[r];
+		if (v.isErr())
+			batch.Fail(r, v);
+		else if (v.isInt())
+			batch.out[r] += to_string(v.ValInt());
+		else
+			batch.out[r].append(v.Data(), v.Length());
+	}
+	scratch.Reset();
+	return Column();
+}
+
+Column Loop::EvalBatch(Batch& batch, const Mask& mask) {
+	Mask m = batch.Running(mask);
+	while (batch.Any(m)) {
+		TestRows(batch, m, left->EvalBatch(batch, m), ERR_LOOP_STRING, linenum);
+		if (!batch.Any(m))
+			break;
+		if (!budget->Tick()) {
+			FailAll(batch, m, Val(budget->Reason()).At(linenum));
+			break;
+		}
+		right->EvalBatch(batch, m);
+		m = batch.Running(m);
+	}
+	return Column();
+}
+
+Column If::EvalBatch(Batch& batch, const Mask& mask) {
+	Mask m = batch.Running(mask);
+	TestRows(batch, m, left->EvalBatch(batch, m), ERR_IF_STRING, linenum);
+	if (batch.Any(m))
+		right->EvalBatch(batch, m);
+	return Column();
+}
+
+Column PlusExpr::EvalBatch(Batch& batch, const Mask& mask) {
+	Column L = left->EvalBatch(batch, mask);
+	Column R = right->EvalBatch(batch, mask);
+	if (L.IsInt() && R.IsInt())
+		return Ints(L, R, AddInts);
+	return EachRow(batch, mask, linenum, [&](size_t r) { return L.Get(r) + R.Get(r); });
+}
+
+Column MinusExpr::EvalBatch(Batch& batch, const Mask& mask) {
+	Column L = left->EvalBatch(batch, mask);
+	Column R = right->EvalBatch(batch, mask);
+	if (L.IsInt() && R.IsInt())
+		return Ints(L, R, SubtractInts);
+	return EachRow(batch, mask, linenum, [&](size_t r) { return L.Get(r) - R.Get(r); });
+}
+
+Column TimesExpr::EvalBatch(Batch& batch, const Mask& mask) {
+	Column L = left->EvalBatch(batch, mask);
+	Column R = right->EvalBatch(batch, mask);
+	if (L.IsInt() && R.IsInt())
+		return Ints(L, R, MultiplyInts);
+	return EachRow(batch, mask, linenum, [&](size_t r) { return L.Get(r) * R.Get(r); });
+}
+
+Column DivideExpr::EvalBatch(Batch& batch, const Mask& mask) {
+	Column L = left->EvalBatch(batch, mask);
+	Column R = right->EvalBatch(batch, mask);
+	bool byZero = false;
+	if (R.IsInt())
+		for (size_t r = 0; r < batch.rows; r++)
+			byZero |= mask[r] && R.Ints()[r] == 0;
+	if (L.IsInt() && R.IsInt() && !byZero)
+		return Ints(L, R, DivideInts);
+	return EachRow(batch, mask, linenum, [&](size_t r) { return L.Get(r) / R.Get(r); });
+}
+
+Column BangExpr::EvalBatch(Batch& batch, const Mask& mask) {
+	Column L = left->EvalBatch(batch, mask);
+	if (L.IsInt()) {
+		Column c;
+		vector<int> v = L.Ints();
+		c.ints.resize(v.size());
+		ReverseInts(v.data(), c.ints.data(), v.size());
+		return c;
+	}
+	return EachRow(batch, mask, linenum, [&](size_t r) { return !L.Get(r); });
+}
+
+Column IConst::EvalBatch(Batch& batch, const Mask&) {
+	return Fill(batch.rows, Val(val));
+}
+
+Column SConst::EvalBatch(Batch& batch, const Mask&) {
+	return Fill(batch.rows, Val::Ref(val));
+}
+
+Column Ident::EvalBatch(Batch& batch, const Mask& mask) {
+	Val preset;
+	bool hasPreset = batch.Preset(*id, preset);
+	map<string,Column>::const_iterator it = batch.vars.find(*id);
+	if (it == batch.vars.end())
+		return Fill(batch.rows, hasPreset ? preset : Val(ERR_UNSET_VARIABLE, *id).At(linenum));
+
+	// a row no let has set reads the snapshot or fails, so only a
+	// variable every running row has set can be read in place
+	const Column& var = it->second;
+	bool set = true;
+	if (!var.IsInt())
+		for (size_t r = 0; r < batch.rows && set; r++)
+			set = !mask[r] || !Unset(var.vals[r]);
+	if (set)
+		return Column::View(var);
+	return EachRow(batch, mask, linenum, [&](size_t r) {
+		if (!Unset(var.vals[r]))
+			return Val::Borrow(var.vals[r]);
+		return hasPreset ? preset : Val(ERR_UNSET_VARIABLE, *id);
+	});
+}
+
+bool ReadColumns(istream& in, Columns& columns, string& error) {
+	string line;
+	int lineNumber = 0;
+	while (getline(in, line)) {
+		lineNumber++;
+		string where = "line " + to_string(lineNumber) + ": ";
+		vector<string> words;
+		if (!SplitWords(line, words)) {
+			error = where + "unterminated string";
+			return false;
+		}
+		if (words.empty())
+			continue;
+		if (!IsIdentifier(words[0])) {
+			error = where + "bad variable name " + words[0];
+			return false;
+		}
+		for (auto& c : columns) {
+			if (c.first == words[0]) {
+				error = where + words[0] + " given twice";
+				return false;
+			}
+		}
+
+		vector<Val> vals;
+		for (size_t i = 1; i < words.size(); i++) {
+			Val v;
+			if (!ParseBinding(words[i], v)) {
+				error = where + "bad value " + words[i];
+				return false;
+			}
+			vals.push_back(v);
+		}
+		if (!columns.empty() && vals.size() != columns[0].second.size()) {
+			error = where + words[0] + " has " + to_string(vals.size()) + " rows, not "
+					+ to_string(columns[0].second.size());
+			return false;
+		}
+		columns.push_back(make_pair(words[0], vals));
+	}
+	return true;
+}
+
+void RunBatches(ParseTree *prog, const Columns& input, size_t size, const SnapshotRef& base, ostream& out) {
+	size_t total = input.empty() ? 0 : input[0].second.size();
+	for (size_t start = 0; start < total; start += size) {
+		size_t rows = min(size, total - start);
+		Batch batch(rows, base);
+		for (auto& col : input) {
+			Column c;
+			c.vals.assign(col.second.begin() + start, col.second.begin() + start + rows);
+			Narrow(c);
+			batch.vars[col.first] = std::move(c);
+		}
+
+		prog->EvalBatch(batch, Mask(rows, 1));
+		for (size_t r = 0; r < rows; r++)
+			out << "ROW " << start + r << " " << batch.out[r].length() << "\n" << batch.out[r] << "\n";
+	}
+}
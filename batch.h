@@ -0,0 +1,103 @@
+/*
+ * batch.h
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include "parsetree.h"
+#include "symtab.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+using std::string;
+using std::vector;
+using std::map;
+using std::ostream;
+using std::istream;
+
+// Batch mode runs one program over many rows of initial bindings at once.
+// Every node evaluates a Column, one value per row, instead of a single
+// Val.  Rows that are all ints are kept in a plain int array, so + - * /
+// and ! on them are loops over arrays the compiler can vectorize; strings,
+// unset variables and errors fall back to a Val per row.  If and loop
+// narrow a Mask of the rows that are running, so rows can take different
+// paths through the program.  A row that hits a runtime error stops
+// there, and each row's output is kept apart from the others.
+//
+// The output of each row is what running the program alone with that
+// row's bindings would print, written as a record of its own (see
+// RunBatches).  Fuel is the one exception: it is burned
+// once per statement per batch, not once per row.
+//
+// A column read from a variable is a view of the variable's rows, which
+// nothing changes before the statement reading it is done, so reading a
+// variable copies nothing.  Readers go through Ints() and Vals(); only a
+// column that holds its own rows is written to.
+class Column {
+	const Column	*view;		// the variable's column this one reads, or null
+
+public:
+	vector<int>	ints;		// every row, when all of them are ints
+	vector<Val>	vals;		// every row otherwise; empty when ints is used
+
+	Column() : view(0) {}
+
+	// a column that reads the rows of var
+	static Column View(const Column& var) {
+		Column c;
+		c.view = &var;
+		return c;
+	}
+
+	bool IsView() const { return view != 0; }
+	const vector<int>& Ints() const { return view ? view->ints : ints; }
+	const vector<Val>& Vals() const { return view ? view->vals : vals; }
+	bool IsInt() const { return Vals().empty(); }
+
+	// the value of row r; a string is a view of this column
+	Val Get(size_t r) const { return IsInt() ? Val(Ints()[r]) : Val::Borrow(Vals()[r]); }
+
+	// switches to one Val per row
+	void ToVals();
+};
+
+class Batch {
+	SnapshotRef		base;
+	vector<unsigned char>	alive;		// rows that have not stopped with an error
+
+public:
+	size_t				rows;
+	map<string,Column>	vars;
+	vector<string>		out;		// the output of each row
+
+	Batch(size_t rows, const SnapshotRef& base);
+
+	// the rows of mask that have not stopped
+	Mask Running(const Mask& mask) const;
+	bool Any(const Mask& mask) const;
+
+	// stops row r and records the error in its output
+	void Fail(size_t r, const Val& err);
+
+	// the value of a variable the rows have not set, from the snapshot
+	bool Preset(const string& id, Val& v) const { return base && base->Get(id, v); }
+};
+
+// The columns of a batch input file: one line per variable, its name and
+// then one value per row, written as for a binding
+typedef vector<std::pair<string, vector<Val>>> Columns;
+
+// reads a columns file; false, with the reason in error, if it is malformed
+extern bool ReadColumns(istream& in, Columns& columns, string& error);
+
+// Runs prog over every row of input, size rows at a time, and writes the
+// output of each row to out in row order, as one record per row: a line
+// "ROW index length", with the row counted from 0, then the length bytes
+// the row printed, then a newline.  The length lets a reader find where
+// a row ends whatever the row printed, and a row that printed nothing
+// still has its record.
+extern void RunBatches(ParseTree *prog, const Columns& input, size_t size, const SnapshotRef& base, ostream& out);
+
+#endif /* BATCH_H_ */
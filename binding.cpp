@@ -0,0 +1,67 @@
+/*
+ * binding.cpp
+ */
+
+#include "binding.h"
+#include <cctype>
+using namespace std;
+
+bool SplitWords(const string& line, vector<string>& words) {
+	string word;
+	bool inWord = false, quoted = false;
+	for (size_t i = 0; i < line.length(); i++) {
+		char ch = line[i];
+		if (!quoted && isspace((unsigned char)ch)) {
+			if (inWord)
+				words.push_back(word);
+			word.clear();
+			inWord = false;
+			continue;
+		}
+		inWord = true;
+		word += ch;
+		if (ch == '\\' && quoted && i + 1 < line.length())
+			word += line[++i];
+		else if (ch == '"')
+			quoted = !quoted;
+	}
+	if (inWord)
+		words.push_back(word);
+	return !quoted;
+}
+
+bool ParseBinding(const string& text, Val& v) {
+	if (text.length() >= 2 && text[0] == '"' && text[text.length() - 1] == '"') {
+		string s;
+		for (size_t i = 1; i + 1 < text.length(); i++) {
+			char ch = text[i];
+			if (ch == '\\') {
+				ch = text[++i];
+				if (ch == 'n')
+					ch = '\n';
+			}
+			s += ch;
+		}
+		v = Val(s);
+		return true;
+	}
+	size_t start = (!text.empty() && text[0] == '-') ? 1 : 0;
+	if (text.length() == start || text.find_first_not_of("0123456789", start) != string::npos)
+		return false;
+	try {
+		v = Val(stoi(text));
+	}
+	catch(...) {
+		return false;
+	}
+	return true;
+}
+
+bool IsIdentifier(const string& id) {
+	if (id.empty() || !isalpha((unsigned char)id[0]))
+		return false;
+	for (char ch : id)
+		if (!isalnum((unsigned char)ch))
+			return false;
+	return true;
+}
@@ -0,0 +1,26 @@
+/*
+ * binding.h
+ */
+
+#ifndef BINDING_H_
+#define BINDING_H_
+
+#include "val.h"
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+// Initial values for variables are written the same way everywhere they
+// come from outside a program: an integer, or a double-quoted string with
+// \" \\ and \n escapes.
+
+// Splits a line into words at whitespace outside double quotes; false if a quote is left open
+extern bool SplitWords(const string& line, vector<string>& words);
+
+// Converts the text of a value into a Val; false if it is neither an integer nor a string
+extern bool ParseBinding(const string& text, Val& v);
+
+extern bool IsIdentifier(const string& id);
+
+#endif /* BINDING_H_ */
@@ -0,0 +1,71 @@
+/*
+ * budget.cpp
+ */
+
+#include "budget.h"
+using namespace std;
+
+static thread_local Budget unlimited;
+thread_local Budget *budget = &unlimited;
+
+void Budget::SetTimeout(long long ms) {
+	hasDeadline = true;
+	timeoutMs = ms;
+}
+
+void Budget::StartClock() {
+	if (!hasDeadline)
+		return;
+	deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+	slice = 0;
+}
+
+Budget Budget::Share() const {
+	Budget b(*this);
+	b.SetFuel(Left());
+	b.reason = ERR_NONE;
+	return b;
+}
+
+// Slow path of Tick(): check the deadline, then hand out the next slice of fuel
+bool Budget::Refill() {
+	slice = 0;
+	if (hasDeadline && chrono::steady_clock::now() >= deadline) {
+		reason = ERR_TIME_LIMIT;
+		return false;
+	}
+	if (fuel < 0) {
+		slice = SLICE - 1;
+		return true;
+	}
+	if (fuel == 0) {
+		reason = ERR_INSTRUCTION_LIMIT;
+		return false;
+	}
+	long long n = fuel < SLICE ? fuel : SLICE;
+	fuel -= n;
+	slice = n - 1;
+	return true;
+}
+
+bool Budget::Charge(long long n) {
+	if (n <= slice) {
+		slice -= n;
+		return true;
+	}
+	n -= slice;
+	slice = 0;
+	if (hasDeadline && chrono::steady_clock::now() >= deadline) {
+		reason = ERR_TIME_LIMIT;
+		return false;
+	}
+	if (fuel < 0)
+		return true;
+	if (fuel < n) {
+		fuel = 0;
+		reason = ERR_INSTRUCTION_LIMIT;
+		return false;
+	}
+	fuel -= n;
+	return true;
+}
@@ -0,0 +1,73 @@
+/*
+ * budget.h
+ */
+
+#ifndef BUDGET_H_
+#define BUDGET_H_
+
+#include <string>
+#include <chrono>
+#include "errcode.h"
+using std::string;
+
+// Budget holds the execution limits for one run of a program: fuel that is
+// burned once per statement and once per loop back-edge, a cap on the size
+// of any string built by a Val operator, and a wall-clock deadline.
+//
+// Fuel is handed out in slices so that Tick() is a single decrement and
+// branch; the deadline is only looked at when a slice runs out.
+class Budget {
+	long long	fuel;		// fuel not yet handed out, -1 if unlimited
+	long long	slice;		// ticks left before the next slow-path check
+	size_t		maxStr;		// largest string a Val operator may build, 0 if unlimited
+	bool		hasDeadline;
+	long long	timeoutMs;
+	std::chrono::steady_clock::time_point deadline;
+	ErrCode		reason;
+
+	static const long long SLICE = 1024;
+
+	bool Refill();
+
+public:
+	Budget() : fuel(-1), slice(0), maxStr(0), hasDeadline(false), timeoutMs(0), reason(ERR_NONE) {}
+
+	void SetFuel(long long f) { fuel = f; slice = 0; }
+	void SetMaxString(size_t bytes) { maxStr = bytes; }
+	// the timeout counts from the next StartClock, so that it covers the
+	// run and not the loading before it
+	void SetTimeout(long long ms);
+
+	// starts the timeout, if any, from the current time
+	void StartClock();
+
+	// burn one unit of fuel; false once any limit has been hit
+	bool Tick() { return --slice >= 0 || Refill(); }
+
+	// burn n units of fuel at once, for an operator whose work grows with
+	// its operands; false once any limit has been hit
+	bool Charge(long long n);
+
+	// true if a string of count copies of len bytes is within the cap
+	bool StringFits(size_t len, size_t count = 1) const {
+		if (maxStr == 0 || len == 0)
+			return true;
+		return count <= maxStr / len;
+	}
+
+	ErrCode Reason() const { return reason; }
+
+	// fuel not yet burned, -1 if unlimited
+	long long Left() const { return fuel < 0 ? -1 : fuel + (slice > 0 ? slice : 0); }
+
+	// A budget for work done on another thread on behalf of this one: the
+	// same limits, with all the fuel this one has left.  A Budget is not
+	// shared between threads; the owner charges what the share burned
+	// back to itself once the work is done.
+	Budget Share() const;
+};
+
+// the budget charged by the thread that is currently evaluating
+extern thread_local Budget *budget;
+
+#endif /* BUDGET_H_ */
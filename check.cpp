@@ -0,0 +1,110 @@
+/*
+ * check.cpp
+ */
+
+#include "check.h"
+#include <unordered_set>
+using namespace std;
+
+ostream& operator<<(ostream& out, const Diagnostic& d) {
+	out << "UNDECLARED VARIABLE " << d.id;
+	return out;
+}
+
+namespace {
+
+// The language only has structured control flow, so the control-flow
+// graph is the tree itself: a statement list runs its statements in
+// order, and the body of an if or a loop may run zero or more times.
+//
+// Two facts are tracked at each point.  "let" holds every variable that
+// some let earlier in the program assigns; a read of anything else is an
+// error.  "definite" holds the variables assigned on every path; on leaving
+// an if or loop body it is rolled back with an undo log rather than
+// copied, which keeps the whole pass linear.
+class AssignmentCheck {
+	unordered_set<string>	let;
+	unordered_set<string>	definite;
+	vector<string>			added;		// undo log for definite
+	vector<Diagnostic>		diags;
+	const Snapshot			*base;
+	const CheckContext		*entry;
+
+	// true if the run starts with id set
+	bool Preset(const string& id) const {
+		Val v;
+		return base && base->Get(id, v);
+	}
+
+	void Assign(const string& id) {
+		let.insert(id);
+		if (definite.insert(id).second)
+			added.push_back(id);
+	}
+
+	void Rollback(size_t mark) {
+		while (added.size() > mark) {
+			definite.erase(added.back());
+			added.pop_back();
+		}
+	}
+
+	void Expr(ParseTree *e) {
+		if (e == 0)
+			return;
+		if (e->IsIdent()) {
+			Ident *id = static_cast<Ident*>(e);
+			const string& name = id->GetId();
+			bool preset = Preset(name);
+			if (let.find(name) == let.end() && !preset && !(entry && entry->Assigned(name)))
+				diags.push_back(Diagnostic(id->GetLineNumber(), name));
+			id->SetAssigned(definite.find(name) != definite.end() || preset
+					|| (entry && entry->DefinitelyAssigned(name)));
+			return;
+		}
+		Expr(e->Left());
+		Expr(e->Right());
+	}
+
+	void Stmt(ParseTree *s) {
+		if (s->IsStmtList()) {
+			for (; s != 0; s = s->Right())
+				Stmt(s->Left());
+		}
+		else if (s->IsLet()) {
+			Expr(s->Left());
+			Assign(s->GetId());
+		}
+		else if (s->IsIf() || s->IsLoop()) {
+			Expr(s->Left());
+			size_t mark = added.size();
+			Stmt(s->Right());
+			Rollback(mark);
+		}
+		else {
+			Expr(s->Left());
+		}
+	}
+
+public:
+	AssignmentCheck(const vector<string>& bound, const Snapshot *base, const CheckContext *entry = 0)
+			: base(base), entry(entry) {
+		for (const string& id : bound)
+			Assign(id);
+	}
+
+	vector<Diagnostic> Run(ParseTree *prog) {
+		Stmt(prog);
+		return diags;
+	}
+};
+
+}
+
+vector<Diagnostic> CheckAssignments(ParseTree *prog, const vector<string>& bound, const Snapshot *base) {
+	return AssignmentCheck(bound, base).Run(prog);
+}
+
+vector<Diagnostic> CheckAssignments(ParseTree *stmt, const CheckContext& entry, const Snapshot *base) {
+	return AssignmentCheck(vector<string>(), base, &entry).Run(stmt);
+}
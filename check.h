@@ -0,0 +1,52 @@
+/*
+ * check.h
+ */
+
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include "parsetree.h"
+#include <string>
+#include <vector>
+#include <iostream>
+using std::string;
+using std::vector;
+using std::ostream;
+
+// A read of a variable that no let before it in the program assigns
+class Diagnostic {
+public:
+	int		line;
+	string	id;
+
+	Diagnostic(int line, const string& id) : line(line), id(id) {}
+};
+
+extern ostream& operator<<(ostream& out, const Diagnostic& d);
+
+// What holds on entry to a part of a program that is checked on its own
+class CheckContext {
+public:
+	virtual ~CheckContext() {}
+
+	// true if a let earlier in the program assigns id
+	virtual bool Assigned(const string& id) const = 0;
+
+	// true if id is assigned on every path to the part being checked
+	virtual bool DefinitelyAssigned(const string& id) const = 0;
+};
+
+// Checks that every variable is let before it is used, in one pass over
+// the program.  Variables in bound are taken as assigned before the
+// program starts, and so are those held by base, the snapshot the run
+// will start from.  Returns the reads that nothing can have assigned, in
+// source order, and marks each Ident that is assigned on every path to it
+// so that its evaluation can skip the unset-variable check.
+extern vector<Diagnostic> CheckAssignments(ParseTree *prog, const vector<string>& bound = vector<string>(),
+		const Snapshot *base = 0);
+
+// Checks one statement of a larger program the same way, given what
+// holds on entry to it
+extern vector<Diagnostic> CheckAssignments(ParseTree *stmt, const CheckContext& entry, const Snapshot *base = 0);
+
+#endif /* CHECK_H_ */
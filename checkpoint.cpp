@@ -0,0 +1,245 @@
+/*
+ * checkpoint.cpp
+ */
+
+#include "checkpoint.h"
+#include <fstream>
+#include <iterator>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+static const char MAGIC[8] = { 'L', 'A', 'N', 'G', 'C', 'K', 'P', '1' };
+static const size_t HEADER = sizeof(MAGIC) + sizeof(uint64_t);
+
+// FNV-1a, to tell programs apart and to catch records cut short
+static uint64_t Hash(const char *data, size_t len) {
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)data[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+template <class T>
+static void Put(string& buf, T value) {
+	buf.append((const char*)&value, sizeof(value));
+}
+
+// Reads a T at pos and advances it; false if the data ends first
+template <class T>
+static bool Take(const string& buf, size_t& pos, size_t end, T& value) {
+	if (end - pos < sizeof(value))
+		return false;
+	memcpy(&value, buf.data() + pos, sizeof(value));
+	pos += sizeof(value);
+	return true;
+}
+
+static void Number(ParseTree *node, vector<ParseTree*>& nodes) {
+	for (; node != 0; node = node->Right()) {
+		nodes.push_back(node);
+		Number(node->Left(), nodes);
+	}
+}
+
+Checkpoint::Checkpoint(const string& path, ParseTree *prog, const string& text)
+		: path(path), source(Hash(text.data(), text.length())), file(0), flushed(0) {
+	Number(prog, nodes);
+	for (size_t i = 0; i < nodes.size(); i++)
+		index[nodes[i]] = i;
+}
+
+Checkpoint::~Checkpoint() {
+	if (file)
+		fclose(file);
+}
+
+// A record of the stack and of the variables that have changed, or of
+// every variable if everything is set
+string Checkpoint::Record(Task& t, bool everything) {
+	string payload;
+	Put<uint64_t>(payload, flushed);
+
+	const vector<Task::Frame>& stack = t.Stack();
+	Put<uint32_t>(payload, stack.size());
+	for (const Task::Frame& f : stack) {
+		Put<uint32_t>(payload, index[f.node]);
+		Put<uint8_t>(payload, f.looped);
+	}
+
+	vector<const SymbolTable::Entry*> vars = t.Symbols().TakeChanges();
+	if (everything) {
+		vars.clear();
+		for (auto& v : t.Symbols().Local())
+			vars.push_back(&v);
+	}
+	Put<uint32_t>(payload, vars.size());
+	for (const SymbolTable::Entry *v : vars) {
+		Put<uint32_t>(payload, v->first.length());
+		payload += v->first;
+		if (v->second.isInt()) {
+			Put<uint8_t>(payload, 0);
+			Put<int32_t>(payload, v->second.ValInt());
+		}
+		else {
+			Put<uint8_t>(payload, 1);
+			Put<uint64_t>(payload, v->second.Length());
+			payload.append(v->second.Data(), v->second.Length());
+		}
+	}
+
+	string record;
+	Put<uint32_t>(record, payload.length());
+	record += payload;
+	Put<uint64_t>(record, Hash(payload.data(), payload.length()));
+	return record;
+}
+
+bool Checkpoint::Append(const string& record) {
+	if (fwrite(record.data(), 1, record.length(), file) != record.length() || fflush(file) != 0)
+		return false;
+#ifndef _WIN32
+	fsync(fileno(file));
+#endif
+	return true;
+}
+
+bool Checkpoint::Start(Task& t) {
+	file = fopen(path.c_str(), "wb");
+	if (file == 0)
+		return false;
+	t.Symbols().TrackChanges();
+	string header(MAGIC, sizeof(MAGIC));
+	Put<uint64_t>(header, source);
+	return Append(header);
+}
+
+// Cuts standard output back to bytes if it is a regular file that has
+// grown past them; output written after the last record is written again
+static void TrimOutput(uint64_t bytes) {
+#ifndef _WIN32
+	struct stat st;
+	if (fstat(STDOUT_FILENO, &st) == 0 && S_ISREG(st.st_mode) && (uint64_t)st.st_size > bytes
+			&& ftruncate(STDOUT_FILENO, bytes) == 0)
+		lseek(STDOUT_FILENO, 0, SEEK_END);
+#endif
+}
+
+bool Checkpoint::Resume(Task& t) {
+	ifstream in(path, ios::binary);
+	if (!in.is_open())
+		return false;
+	string log((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+	in.close();
+
+	uint64_t hash;
+	size_t pos = sizeof(MAGIC);
+	if (log.length() < HEADER || memcmp(log.data(), MAGIC, sizeof(MAGIC)) != 0
+			|| !Take(log, pos, log.length(), hash) || hash != source)
+		return false;
+
+	// a log with no records resumes from the start of the program
+	vector<Task::Frame> stack(1, Task::Frame{nodes[0], false});
+	uint64_t outputBytes = 0;
+	map<string,Val> vars;
+
+	// replays every whole record; the first one that is cut short or
+	// does not add up ends the log
+	while (true) {
+		uint32_t len;
+		size_t start = pos;
+		if (!Take(log, pos, log.length(), len) || log.length() - pos < len + sizeof(uint64_t))
+			break;
+		size_t end = pos + len;
+		size_t check = end;
+		if (!Take(log, check, log.length(), hash) || hash != Hash(log.data() + pos, len))
+			break;
+
+		vector<Task::Frame> frames;
+		map<string,Val> changed;
+		uint64_t bytes;
+		uint32_t nframes, nvars;
+		bool ok = Take(log, pos, end, bytes) && Take(log, pos, end, nframes);
+		for (uint32_t i = 0; ok && i < nframes; i++) {
+			uint32_t node;
+			uint8_t looped;
+			ok = Take(log, pos, end, node) && Take(log, pos, end, looped) && node < nodes.size();
+			if (ok)
+				frames.push_back(Task::Frame{nodes[node], looped != 0});
+		}
+		ok = ok && Take(log, pos, end, nvars);
+		for (uint32_t i = 0; ok && i < nvars; i++) {
+			uint32_t nameLen;
+			uint8_t kind;
+			ok = Take(log, pos, end, nameLen) && end - pos >= nameLen;
+			if (!ok)
+				break;
+			string name(log, pos, nameLen);
+			pos += nameLen;
+			ok = Take(log, pos, end, kind);
+			if (ok && kind == 0) {
+				int32_t value;
+				ok = Take(log, pos, end, value);
+				if (ok)
+					changed[name] = Val((int)value);
+			}
+			else if (ok && kind == 1) {
+				uint64_t valueLen;
+				ok = Take(log, pos, end, valueLen) && end - pos >= valueLen;
+				if (ok) {
+					changed[name] = Val(string(log, pos, valueLen));
+					pos += valueLen;
+				}
+			}
+			else
+				ok = false;
+		}
+		if (!ok || pos != end) {
+			pos = start;
+			break;
+		}
+
+		pos = check;
+		stack = frames;
+		outputBytes = bytes;
+		for (auto& v : changed)
+			vars[v.first] = v.second;
+	}
+
+	for (auto& v : vars)
+		t.Symbols().Set(v.first, v.second);
+	t.Stack() = stack;
+	t.Symbols().TrackChanges();
+	flushed = outputBytes;
+	cout.flush();
+	TrimOutput(flushed);
+
+	// the log is replaced by one record of the whole state, which also
+	// drops anything cut short; the rename makes the swap all or nothing
+	string tmp = path + ".tmp";
+	file = fopen(tmp.c_str(), "wb");
+	if (file == 0)
+		return false;
+	string header(MAGIC, sizeof(MAGIC));
+	Put<uint64_t>(header, source);
+	if (!Append(header + Record(t, true)))
+		return false;
+#ifdef _WIN32
+	remove(path.c_str());
+#endif
+	return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool Checkpoint::Write(Task& t, ostream& out) {
+	string text = t.TakeOutput();
+	out << text;
+	out.flush();
+	flushed += text.length();
+	return Append(Record(t, false));
+}
@@ -0,0 +1,61 @@
+/*
+ * checkpoint.h
+ */
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include "sched.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+using std::string;
+using std::vector;
+
+// A Checkpoint records the progress of a Task in a file, so that a run
+// that is killed can be resumed from the last record written.
+//
+// The file is a log.  After an 8-byte magic and a hash of the program
+// text, each record holds the number of output bytes written so far,
+// the Task's stack with nodes numbered in preorder, and the variables
+// set since the previous record.  Replaying the records in order
+// rebuilds the state at the last one; a record cut short by a crash is
+// dropped.  Records are only written at loop back-edges and when the
+// program ends, where the stack is all the position there is.
+//
+// Output is written before the record that counts it.  On resume, if
+// standard output is a regular file (appended to with >>), it is cut back
+// to the count in the last record, so the output is the same as that of
+// a run that was never interrupted.
+//
+// Variables from a snapshot are not saved; a run must be resumed with
+// the same --prelude or --snapshot it was started with.
+class Checkpoint {
+	string			path;
+	uint64_t		source;		// hash of the program text
+	vector<ParseTree*>	nodes;	// every node of the program, in preorder
+	std::unordered_map<const ParseTree*,uint32_t>	index;
+	FILE			*file;
+	uint64_t		flushed;	// bytes of output written so far
+
+	string Record(Task& t, bool everything);
+	bool Append(const string& record);
+
+public:
+	Checkpoint(const string& path, ParseTree *prog, const string& text);
+	~Checkpoint();
+
+	// starts a new file for a run of t from the beginning; false if it cannot be written
+	bool Start(Task& t);
+
+	// restores t to the last record in the file; false if there is no
+	// usable file or it was written for a different program
+	bool Resume(Task& t);
+
+	// writes the output t has buffered to out, then a record of t
+	bool Write(Task& t, std::ostream& out);
+};
+
+#endif /* CHECKPOINT_H_ */
@@ -0,0 +1,335 @@
+/*
+ * document.cpp
+ */
+
+#include "document.h"
+#include "parse.h"
+#include <sstream>
+#include <algorithm>
+#include <set>
+#include <climits>
+using namespace std;
+
+namespace {
+
+// A stream over a string that starts part way in and can say where it is
+class TextBuf : public streambuf {
+	char *begin;
+public:
+	TextBuf(const string& text, size_t pos) {
+		begin = const_cast<char*>(text.data());
+		setg(begin, begin + pos, begin + text.length());
+	}
+
+	size_t Pos() const { return gptr() - begin; }
+};
+
+}
+
+// Collects the variables a tree assigns and reads
+static void Names(ParseTree *t, vector<string>& lets, vector<string>& reads) {
+	for (; t != 0; t = t->Right()) {
+		if (t->IsLet())
+			lets.push_back(t->GetId());
+		else if (t->IsIdent())
+			reads.push_back(t->GetId());
+		Names(t->Left(), lets, reads);
+	}
+}
+
+static void Unique(vector<string>& v) {
+	sort(v.begin(), v.end());
+	v.erase(unique(v.begin(), v.end()), v.end());
+}
+
+bool Document::Entry::Assigned(const string& id) const {
+	if (doc.bound.count(id))
+		return true;
+	Uses::const_iterator it = doc.assigners.find(id);
+	if (it != doc.assigners.end())
+		for (Statement *s : it->second)
+			if (s->index < index)
+				return true;
+	return false;
+}
+
+bool Document::Entry::DefinitelyAssigned(const string& id) const {
+	if (doc.bound.count(id))
+		return true;
+	Uses::const_iterator it = doc.topAssigners.find(id);
+	if (it != doc.topAssigners.end())
+		for (Statement *s : it->second)
+			if (s->index < index)
+				return true;
+	return false;
+}
+
+Document::Document(const string& src, const vector<string>& boundNames, const Snapshot *base)
+		: pool(make_shared<ConstPool>()), bound(boundNames.begin(), boundNames.end()), base(base), firstLine(0) {
+	// an empty program, which the first edit fills in
+	tokens.push_back(Lex(DONE, "", firstLine));
+	ends.push_back(0);
+	Statement *s = new Statement();
+	s->index = s->first = s->last = 0;
+	Parse(s);
+	stmts.push_back(s);
+	Edit(0, 0, src);
+}
+
+Document::~Document() {
+	for (Statement *s : stmts) {
+		if (s->link) {
+			s->link->SetRight(0);
+			delete s->link;
+		}
+		delete s;
+	}
+}
+
+// the lexer's line count before a token
+int Document::LineBefore(size_t token) const {
+	return token ? tokens[token - 1].GetLinenum() : firstLine;
+}
+
+void Document::Parse(Statement *s) {
+	int line = LineBefore(s->first);
+	s->tree = ReplayStmt(&tokens[s->first], &tokens[s->last] + 1, pool, line, s->ended);
+
+	s->link = s->tree ? new StmtList(s->tree, 0) : 0;
+	Names(s->tree, s->lets, s->reads);
+	Unique(s->lets);
+	Unique(s->reads);
+	if (s->tree && s->tree->IsLet())
+		s->topLet = s->tree->GetId();
+}
+
+void Document::Index(Statement *s, bool add) {
+	auto update = [&](Uses& uses, const string& id) {
+		vector<Statement*>& v = uses[id];
+		if (add)
+			v.push_back(s);
+		else {
+			v.erase(find(v.begin(), v.end(), s));
+			if (v.empty())
+				uses.erase(id);
+		}
+	};
+	for (const string& id : s->lets)
+		update(assigners, id);
+	if (!s->topLet.empty())
+		update(topAssigners, s->topLet);
+	for (const string& id : s->reads)
+		update(readers, id);
+}
+
+void Document::Check(Statement *s) {
+	if (s->tree)
+		s->diags = CheckAssignments(s->tree, Entry(*this, s->index), base);
+}
+
+void Document::Edit(size_t offset, size_t removed, const string& inserted) {
+	text.replace(offset, removed, inserted);
+	long long delta = (long long)inserted.length() - (long long)removed;
+	size_t oldEditEnd = offset + removed;
+	size_t newEditEnd = offset + inserted.length();
+
+	// A token that ends before the edit cannot change, since the lexer
+	// looks no further than one character past a token.  Lexing starts
+	// after the last of them and stops at the first new token past the
+	// edit that ends where an old one did: from there on the text, and so
+	// every token, is the same as before.
+	size_t from = lower_bound(ends.begin(), ends.end(), offset) - ends.begin();
+	int line = LineBefore(from);
+	TextBuf buf(text, from ? ends[from - 1] : 0);
+	istream in(&buf);
+
+	vector<Lex> newTokens;
+	vector<size_t> newEnds;
+	size_t old = from;
+	while (true) {
+		Lex t = getNextToken(in, line);
+		size_t end = buf.Pos();
+		newTokens.push_back(t);
+		newEnds.push_back(end);
+		if (end >= newEditEnd) {
+			// only DONE can end where the token before it ended
+			while (old < ends.size() && (ends[old] < oldEditEnd || ends[old] + delta < end
+					|| (ends[old] + delta == end && t == DONE && tokens[old] != DONE)))
+				old++;
+			if (ends[old] + delta == end && (t == DONE) == (tokens[old] == DONE))
+				break;
+		}
+	}
+
+	size_t oldLast = old;
+	size_t newLast = from + newTokens.size() - 1;
+	long long tokDelta = (long long)newLast - (long long)oldLast;
+	int lineDelta = newTokens.back().GetLinenum() - tokens[oldLast].GetLinenum();
+	for (size_t k = oldLast + 1; k < tokens.size(); k++) {
+		ends[k] += delta;
+		if (lineDelta)
+			tokens[k] = Lex(tokens[k].GetToken(), tokens[k].GetLexeme(), tokens[k].GetLinenum() + lineDelta);
+	}
+	tokens.erase(tokens.begin() + from, tokens.begin() + oldLast + 1);
+	tokens.insert(tokens.begin() + from, newTokens.begin(), newTokens.end());
+	ends.erase(ends.begin() + from, ends.begin() + oldLast + 1);
+	ends.insert(ends.begin() + from, newEnds.begin(), newEnds.end());
+
+	// Splits the tokens into statements again, from the start of the
+	// statement holding the first new token, until a statement ends on
+	// an unchanged token where an old statement ended.  A statement runs
+	// to a semicolon outside any begin and end, or to DONE.
+	size_t a = 0;
+	while (stmts[a]->last < from)
+		a++;
+	size_t b = a;
+	size_t t = stmts[a]->first;
+	vector<pair<size_t,size_t>> segments;
+	while (true) {
+		size_t start = t;
+		int depth = 0;
+		bool any = false;
+		while (tokens[t] != DONE && !(tokens[t] == SC && depth == 0 && any)) {
+			if (tokens[t] == BEGIN)
+				depth++;
+			else if (tokens[t] == END && depth > 0)
+				depth--;
+			if (tokens[t] != SC)
+				any = true;
+			t++;
+		}
+		segments.push_back(make_pair(start, t));
+		if (tokens[t] == DONE) {
+			b = stmts.size() - 1;
+			break;
+		}
+		if (t >= newLast) {
+			size_t oldEnd = t - tokDelta;
+			while (b < stmts.size() && stmts[b]->last < oldEnd)
+				b++;
+			if (b < stmts.size() && stmts[b]->last == oldEnd)
+				break;
+		}
+		t++;
+	}
+
+	// statements a to b are replaced
+	set<string> oldLets, oldTops;
+	for (size_t i = a; i <= b; i++) {
+		Statement *s = stmts[i];
+		Index(s, false);
+		oldLets.insert(s->lets.begin(), s->lets.end());
+		if (!s->topLet.empty())
+			oldTops.insert(s->topLet);
+		if (s->link) {
+			s->link->SetRight(0);
+			delete s->link;
+		}
+		delete s;
+	}
+	for (size_t i = b + 1; i < stmts.size(); i++) {
+		Statement *s = stmts[i];
+		s->first += tokDelta;
+		s->last += tokDelta;
+		if (lineDelta && s->tree) {
+			s->tree->ShiftLines(lineDelta);
+			for (Diagnostic& d : s->diags)
+				d.line += lineDelta;
+		}
+	}
+
+	vector<Statement*> fresh;
+	for (auto& seg : segments) {
+		Statement *s = new Statement();
+		s->first = seg.first;
+		s->last = seg.second;
+		Parse(s);
+		fresh.push_back(s);
+	}
+	stmts.erase(stmts.begin() + a, stmts.begin() + b + 1);
+	stmts.insert(stmts.begin() + a, fresh.begin(), fresh.end());
+	for (size_t i = 0; i < stmts.size(); i++)
+		stmts[i]->index = i;
+
+	size_t blockEnd = a + fresh.size();
+	for (size_t i = (a ? a - 1 : 0); i < blockEnd; i++)
+		if (stmts[i]->link)
+			stmts[i]->link->SetRight(i + 1 < stmts.size() ? stmts[i + 1]->link : 0);
+
+	set<string> newLets, newTops;
+	for (Statement *s : fresh) {
+		Index(s, true);
+		newLets.insert(s->lets.begin(), s->lets.end());
+		if (!s->topLet.empty())
+			newTops.insert(s->topLet);
+	}
+	for (Statement *s : fresh)
+		Check(s);
+
+	// A later statement only sees the replaced ones through which
+	// variables they assign.  For a variable whose assignments changed,
+	// its readers are checked again up to the next top-level let of it;
+	// past that it is assigned on every path whatever came before.
+	set<string> changed;
+	set_symmetric_difference(oldLets.begin(), oldLets.end(), newLets.begin(), newLets.end(),
+			inserter(changed, changed.end()));
+	set_symmetric_difference(oldTops.begin(), oldTops.end(), newTops.begin(), newTops.end(),
+			inserter(changed, changed.end()));
+	set<Statement*> recheck;
+	for (const string& id : changed) {
+		Uses::iterator readIt = readers.find(id);
+		if (readIt == readers.end())
+			continue;
+		size_t stop = SIZE_MAX;
+		Uses::iterator topIt = topAssigners.find(id);
+		if (topIt != topAssigners.end())
+			for (Statement *s : topIt->second)
+				if (s->index >= blockEnd)
+					stop = min(stop, s->index);
+		for (Statement *s : readIt->second)
+			if (s->index >= blockEnd && s->index <= stop)
+				recheck.insert(s);
+	}
+	for (Statement *s : recheck)
+		Check(s);
+}
+
+ParseTree *Document::Tree() const {
+	for (Statement *s : stmts)
+		if (s->tree == 0)
+			return (s->ended && s->index > 0) ? stmts[0]->link : 0;
+	return 0;
+}
+
+string Document::Errors() const {
+	for (Statement *s : stmts) {
+		if (s->tree != 0)
+			continue;
+		if (s->ended && s->index > 0)
+			return "";
+
+		// The messages are not kept.  Prog goes on past a statement that
+		// reports errors but still gives a tree, so they come from parsing
+		// again from here the way it does.
+		vector<SyntaxError> errors;
+		int line = LineBefore(s->first);
+		ReplayErrors(&tokens[s->first], &tokens.back() + 1, pool, line, s->index == 0, errors);
+		ostringstream out;
+		for (const SyntaxError& e : errors)
+			out << e << endl;
+		return out.str();
+	}
+	return "";
+}
+
+vector<Diagnostic> Document::Diagnostics() const {
+	vector<Diagnostic> diags;
+	if (Tree() == 0)
+		return diags;
+	for (Statement *s : stmts) {
+		if (s->tree == 0)
+			break;
+		diags.insert(diags.end(), s->diags.begin(), s->diags.end());
+	}
+	return diags;
+}
@@ -0,0 +1,104 @@
+/*
+ * document.h
+ */
+
+#ifndef DOCUMENT_H_
+#define DOCUMENT_H_
+
+#include "parsetree.h"
+#include "check.h"
+#include "lex.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+using std::string;
+using std::vector;
+
+// A Document is the text of a program that is being edited, kept parsed
+// and checked as it changes, for editors and for reloading scripts.
+//
+// It keeps the tokens of the text and the statements at the top level of
+// the program.  After an edit only the tokens from the one before the
+// edit up to the first one that ends where an old token ended are lexed
+// again, and only the top-level statements holding those tokens are
+// parsed again.  The assignment check is redone for the new statements
+// and for later statements that read a variable whose assignments
+// changed, up to the next top-level let of that variable, after which
+// nothing the check knows has changed.  Tree, Errors and Diagnostics are
+// always what Prog and CheckAssignments would give for the whole text.
+//
+// Lexing, parsing and checking grow with the edit, not the text.  The
+// bookkeeping does not: token offsets, statement token indexes and line
+// numbers after the edit are stored as absolute values and are moved
+// along one by one, and the token and statement arrays are spliced in
+// place.  That is a pass over memory with no lexing or parsing in it, but
+// it is linear in the size of the text after the edit.  Making it
+// sub-linear, by keeping positions relative to a tree of statements, is
+// deferred.  Syntax errors are not kept either, so Errors parses again
+// from the first statement that has one.
+class Document {
+	struct Statement {
+		size_t		index;		// position among the top-level statements
+		size_t		first;		// index of its first token
+		size_t		last;		// index of its last token, the semicolon or DONE
+		ParseTree	*tree;		// null if it did not parse
+		bool		ended;		// no tree because the program ends here
+		StmtList	*link;		// holds tree in the program's statement list
+		vector<string>	lets;	// variables it assigns anywhere
+		string		topLet;		// the variable it assigns, if it is a let
+		vector<string>	reads;	// variables it reads
+		vector<Diagnostic>	diags;
+	};
+
+	// what holds on entry to one top-level statement
+	class Entry : public CheckContext {
+		const Document&	doc;
+		size_t			index;
+	public:
+		Entry(const Document& doc, size_t index) : doc(doc), index(index) {}
+		bool Assigned(const string& id) const;
+		bool DefinitelyAssigned(const string& id) const;
+	};
+
+	typedef std::unordered_map<string, vector<Statement*>> Uses;
+
+	string				text;
+	vector<Lex>			tokens;
+	vector<size_t>		ends;		// offset just past each token
+	vector<Statement*>	stmts;
+	ConstPoolRef		pool;
+	std::unordered_set<string>	bound;
+	const Snapshot		*base;
+	int					firstLine;
+
+	Uses				assigners;		// statements that let a variable anywhere
+	Uses				topAssigners;	// statements that are a let of it
+	Uses				readers;
+
+	void Parse(Statement *s);
+	void Index(Statement *s, bool add);
+	void Check(Statement *s);
+	int LineBefore(size_t token) const;
+
+public:
+	// bound and base are as for CheckAssignments
+	Document(const string& text, const vector<string>& bound = vector<string>(), const Snapshot *base = 0);
+	~Document();
+
+	// replaces removed bytes at offset with inserted
+	void Edit(size_t offset, size_t removed, const string& inserted);
+
+	const string& Text() const { return text; }
+
+	// the program, or null if it has syntax errors; the Document owns it
+	ParseTree *Tree() const;
+
+	// the syntax errors as Prog prints them, empty if there are none
+	string Errors() const;
+
+	// the undeclared variables, if the program has no syntax errors
+	vector<Diagnostic> Diagnostics() const;
+};
+
+#endif /* DOCUMENT_H_ */
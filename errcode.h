@@ -0,0 +1,42 @@
+/*
+ * errcode.h
+ */
+
+#ifndef ERRCODE_H_
+#define ERRCODE_H_
+
+#include <string>
+using std::string;
+
+// ErrCode is the compact form of a runtime error that travels in a Val;
+// the message text is only built when the error is reported.
+enum ErrCode {
+	ERR_NONE,
+	ERR_PLUS_TYPES, ERR_MINUS_TYPES, ERR_TIMES_TYPES, ERR_DIVIDE_TYPES, ERR_BANG_TYPES,
+	ERR_NEGATIVE_TIMES_STRING, ERR_STRING_TIMES_NEGATIVE, ERR_DIVIDE_BY_ZERO,
+	ERR_IF_STRING, ERR_LOOP_STRING, ERR_UNSET_VARIABLE,
+	ERR_STRING_LIMIT, ERR_INSTRUCTION_LIMIT, ERR_TIME_LIMIT
+};
+
+// detail is the variable name for ERR_UNSET_VARIABLE
+inline string ErrText(ErrCode code, const string& detail) {
+	switch (code) {
+	case ERR_PLUS_TYPES:			return "Type mismatch on operands of +";
+	case ERR_MINUS_TYPES:			return "Type mismatch on operands of -";
+	case ERR_TIMES_TYPES:			return "Type mismatch on operands of *";
+	case ERR_DIVIDE_TYPES:			return "Type mismatch on operands of /";
+	case ERR_BANG_TYPES:			return "Type mismatch on operands of !";
+	case ERR_NEGATIVE_TIMES_STRING:	return "Negative number multiplied by string";
+	case ERR_STRING_TIMES_NEGATIVE:	return "Cannot multiply string by negative int";
+	case ERR_DIVIDE_BY_ZERO:		return "Divide by zero error";
+	case ERR_IF_STRING:				return "Expression is not an integer";
+	case ERR_LOOP_STRING:			return "LoopStmt expression evaluates to string type";
+	case ERR_UNSET_VARIABLE:		return "Variable " + detail + " is used before it is assigned";
+	case ERR_STRING_LIMIT:			return "String length limit exceeded";
+	case ERR_INSTRUCTION_LIMIT:		return "Instruction limit exceeded";
+	case ERR_TIME_LIMIT:			return "Time limit exceeded";
+	default:						return "";
+	}
+}
+
+#endif /* ERRCODE_H_ */
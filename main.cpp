@@ -1,52 +1,456 @@
 #include "parse.h"
+#include "budget.h"
+#include "sched.h"
+#include "server.h"
+#include "check.h"
+#include "parallel.h"
+#include "stats.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "batch.h"
 #include <string>
 #include <fstream>
+#include <sstream>
+#include <iterator>
 #include <map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 using namespace std;
 
+// Parses the numeric value of a --flag=value argument; false if it is not a non-negative number
+static bool FlagValue(const string& arg, const string& flag, long long& value) {
+	string digits = arg.substr(flag.length());
+	if (digits.empty() || digits.find_first_not_of("0123456789") != string::npos)
+		return false;
+	try {
+		value = stoll(digits);
+	}
+	catch(...) {
+		return false;
+	}
+	return true;
+}
+
+// Parses and checks one program that will start from base, with the
+// variables in bound set; null if it has syntax or declaration errors
+static ParseTree *Load(istream& in, const Snapshot *base, const vector<string>& bound = vector<string>()) {
+	int lineNumber = 0;
+	ParseTree *prog;
+	if (stats) {
+		Stats::Phase lexed = stats->lex;
+		{
+			PhaseTimer t(stats->parse);
+			prog = Prog(in, lineNumber);
+		}
+		// lexing happens inside the parse
+		stats->parse.wallMs -= stats->lex.wallMs - lexed.wallMs;
+		stats->parse.cpuMs -= stats->lex.cpuMs - lexed.cpuMs;
+	}
+	else
+		prog = Prog(in, lineNumber);
+	if (prog == 0)
+		return 0;
+
+	vector<Diagnostic> diags;
+	if (stats) {
+		PhaseTimer t(stats->check);
+		diags = CheckAssignments(prog, bound, base);
+	}
+	else
+		diags = CheckAssignments(prog, bound, base);
+	for (const Diagnostic& d : diags)
+		cout << d << endl;
+
+	if(!diags.empty()) {
+		delete prog;
+		return 0;
+	}
+	return prog;
+}
+
+// Loads and runs the prelude script for RunPrelude
+static SnapshotRef LoadPrelude(const string& filename, const SnapshotRef& base, const Budget& limits) {
+	ifstream inFile(filename);
+	if (!inFile.is_open()) {
+		cout << "COULD NOT OPEN " << filename << endl;
+		return SnapshotRef();
+	}
+	ParseTree *prog = Load(inFile, base.get());
+	if (prog == 0)
+		return SnapshotRef();
+
+	SymbolTable symbols(base);
+	Budget preludeLimits(limits);
+	preludeLimits.StartClock();
+	Budget *saved = budget;
+	budget = &preludeLimits;
+	Val result = prog->Eval(symbols);
+	budget = saved;
+	if (result.isErr()) {
+		cout << result.RuntimeError() << endl;
+		delete prog;
+		return SnapshotRef();
+	}
+	SnapshotRef snap = Freeze(symbols);
+	delete prog;
+	return snap;
+}
+
+// Runs the prelude script on top of base and freezes the variables it
+// leaves behind; null if it could not be loaded or stopped with an error.
+// --stats describes the program, so the prelude is not counted.
+static SnapshotRef RunPrelude(const string& filename, const SnapshotRef& base, const Budget& limits) {
+	Stats *saved = stats;
+	stats = 0;
+	SnapshotRef snap = LoadPrelude(filename, base, limits);
+	stats = saved;
+	return snap;
+}
+
+// Runs every file as a Task on the scheduler and prints their outputs in argument order
+static int RunScheduled(const vector<string>& filenames, int nworkers, long long quantum, const Budget& limits, const SnapshotRef& base) {
+	vector<ParseTree*> progs;
+	vector<Task*> tasks;
+	for (const string& filename : filenames) {
+		ifstream inFile(filename);
+		if (!inFile.is_open()) {
+			cout << "COULD NOT OPEN " << filename << endl;
+			continue;
+		}
+		ParseTree *prog = Load(inFile, base.get());
+		if (prog == 0)
+			continue;
+		Task *t = new Task(prog, base);
+		t->limits = limits;
+		progs.push_back(prog);
+		tasks.push_back(t);
+	}
+
+	{
+		Scheduler sched(nworkers, chrono::microseconds(quantum));
+		for (Task *t : tasks)
+			sched.Submit(t);
+		sched.Wait();
+	}
+
+	for (size_t i = 0; i < tasks.size(); i++) {
+		cout << tasks[i]->Output();
+		delete tasks[i];
+		delete progs[i];
+	}
+	return 0;
+}
+
+// Parses and checks one file for --check, going on past syntax errors,
+// and returns a line for each error, "file:line: message", with lines
+// counted from 1
+static string CheckFile(const string& filename, const Snapshot *base) {
+	ifstream inFile(filename);
+	if (!inFile.is_open())
+		return filename + ": COULD NOT OPEN\n";
+
+	int lineNumber = 0;
+	vector<SyntaxError> errors;
+	ParseTree *prog = RecoverProg(inFile, lineNumber, errors);
+	vector<pair<int,string>> found;
+	for (const SyntaxError& e : errors)
+		found.push_back(make_pair(e.line, e.msg));
+	if (prog != 0) {
+		for (const Diagnostic& d : CheckAssignments(prog, vector<string>(), base)) {
+			ostringstream msg;
+			msg << d;
+			found.push_back(make_pair(d.line, msg.str()));
+		}
+		delete prog;
+	}
+	stable_sort(found.begin(), found.end(),
+			[](const pair<int,string>& a, const pair<int,string>& b) { return a.first < b.first; });
+
+	ostringstream report;
+	for (auto& f : found)
+		report << filename << ":" << f.first + 1 << ": " << f.second << "\n";
+	return report.str();
+}
+
+// Checks every file on nthreads threads and prints their errors in
+// argument order; 1 if any file has an error
+static int CheckFiles(const vector<string>& filenames, int nthreads, const Snapshot *base) {
+	vector<string> reports(filenames.size());
+	atomic<size_t> next(0);
+	auto work = [&]() {
+		for (size_t i = next++; i < filenames.size(); i = next++)
+			reports[i] = CheckFile(filenames[i], base);
+	};
+	vector<thread> threads;
+	for (int i = 1; i < nthreads; i++)
+		threads.push_back(thread(work));
+	work();
+	for (thread& t : threads)
+		t.join();
+
+	size_t failed = 0;
+	for (const string& r : reports) {
+		cout << r;
+		if (!r.empty())
+			failed++;
+	}
+	cout << "CHECKED " << filenames.size() << " FILES, " << failed << " WITH ERRORS" << endl;
+	return failed ? 1 : 0;
+}
+
+// Runs the program as a Task that stops at a loop back-edge every
+// interval milliseconds to write a checkpoint, starting from the last
+// checkpoint instead if resume is set
+static void RunCheckpointed(ParseTree *prog, const string& text, const SnapshotRef& base, const Budget& limits,
+		const string& path, long long interval, bool resume) {
+	Task t(prog, base);
+	t.limits = limits;
+	Checkpoint cp(path, prog, text);
+	if (resume ? !cp.Resume(t) : !cp.Start(t)) {
+		cout << (resume ? "COULD NOT RESUME FROM " : "COULD NOT WRITE CHECKPOINT ") << path << endl;
+		return;
+	}
+
+	Stats::Phase unused;
+	PhaseTimer timer(stats ? stats->run : unused);
+	bool finished;
+	do {
+		finished = t.Run(chrono::milliseconds(interval));
+		if (!cp.Write(t, cout)) {
+			cout << "COULD NOT WRITE CHECKPOINT " << path << endl;
+			return;
+		}
+	} while (!finished);
+	if (stats)
+		stats->symbols = t.Symbols().Local().size();
+}
+
 int main(int argc, char *argv[]) {
 
 	// Handling Command Line Arguments
 
 	istream *in = &cin;
 	ifstream inFile;
+	vector<string> filenames;
+	Budget limits;
+	long long nworkers = 0;
+	long long quantum = 1000;
+	string socketPath;
+	long long nparallel = 0;
+	Stats runStats;
+	bool statsJson = false;
+	string preludePath, snapshotPath, savePath;
+	string checkpointPath;
+	long long checkpointInterval = 1000;
+	bool resume = false;
+	string batchPath;
+	long long batchSize = 1024;
+	bool check = false;
 
-	if (argc > 2) {
+	for (int i = 1; i < argc; i++) {
+		string arg(argv[i]);
+		long long value;
+		if (arg.compare(0, 2, "--") != 0)
+			filenames.push_back(arg);
+		else if (arg.compare(0, 7, "--fuel=") == 0 && FlagValue(arg, "--fuel=", value))
+			limits.SetFuel(value);
+		else if (arg.compare(0, 13, "--max-string=") == 0 && FlagValue(arg, "--max-string=", value))
+			limits.SetMaxString(value);
+		else if (arg.compare(0, 10, "--timeout=") == 0 && FlagValue(arg, "--timeout=", value))
+			limits.SetTimeout(value);
+		else if (arg.compare(0, 10, "--workers=") == 0 && FlagValue(arg, "--workers=", value) && value > 0)
+			nworkers = value;
+		else if (arg.compare(0, 10, "--quantum=") == 0 && FlagValue(arg, "--quantum=", value))
+			quantum = value;
+		else if (arg.compare(0, 11, "--parallel=") == 0 && FlagValue(arg, "--parallel=", value) && value > 0)
+			nparallel = value;
+		else if (arg == "--stats" || arg == "--stats=json") {
+			stats = &runStats;
+			statsJson = (arg == "--stats=json");
+		}
+		else if (arg.compare(0, 8, "--serve=") == 0 && arg.length() > 8)
+			socketPath = arg.substr(8);
+		else if (arg.compare(0, 10, "--prelude=") == 0 && arg.length() > 10)
+			preludePath = arg.substr(10);
+		else if (arg.compare(0, 11, "--snapshot=") == 0 && arg.length() > 11)
+			snapshotPath = arg.substr(11);
+		else if (arg.compare(0, 16, "--save-snapshot=") == 0 && arg.length() > 16)
+			savePath = arg.substr(16);
+		else if (arg.compare(0, 13, "--checkpoint=") == 0 && arg.length() > 13)
+			checkpointPath = arg.substr(13);
+		else if (arg.compare(0, 22, "--checkpoint-interval=") == 0 && FlagValue(arg, "--checkpoint-interval=", value))
+			checkpointInterval = value;
+		else if (arg == "--resume")
+			resume = true;
+		else if (arg.compare(0, 8, "--batch=") == 0 && arg.length() > 8)
+			batchPath = arg.substr(8);
+		else if (arg.compare(0, 13, "--batch-size=") == 0 && FlagValue(arg, "--batch-size=", value) && value > 0)
+			batchSize = value;
+		else if (arg == "--check")
+			check = true;
+		else {
+			cout << "UNRECOGNIZED FLAG " << arg << endl;
+			return 0;
+		}
+	}
+
+	if (resume && checkpointPath.empty()) {
+		cout << "--resume NEEDS --checkpoint" << endl;
+		return 0;
+	}
+	if (!checkpointPath.empty() && (nworkers > 0 || !socketPath.empty() || !batchPath.empty())) {
+		cout << "--checkpoint ONLY WORKS ON A SINGLE PROGRAM" << endl;
+		return 0;
+	}
+	if (!batchPath.empty() && (nworkers > 0 || !socketPath.empty())) {
+		cout << "--batch ONLY WORKS ON A SINGLE PROGRAM" << endl;
+		return 0;
+	}
+	if (stats && (nworkers > 0 || !socketPath.empty() || check)) {
+		cout << "--stats ONLY WORKS ON A SINGLE PROGRAM" << endl;
+		return 0;
+	}
+	if (check && (!socketPath.empty() || !batchPath.empty() || !checkpointPath.empty())) {
+		cout << "--check ONLY PARSES AND CHECKS FILES" << endl;
+		return 0;
+	}
+
+	// the variables every run starts with: a saved snapshot, then whatever
+	// the prelude adds to it
+	SnapshotRef base;
+	if (!snapshotPath.empty()) {
+		base = OpenSnapshot(snapshotPath);
+		if (!base) {
+			cout << "COULD NOT OPEN SNAPSHOT " << snapshotPath << endl;
+			return 0;
+		}
+	}
+	if (!preludePath.empty()) {
+		base = RunPrelude(preludePath, base, limits);
+		if (!base)
+			return 0;
+	}
+	if (!savePath.empty()) {
+		if (!base || !SaveSnapshot(*base, savePath)) {
+			cout << "COULD NOT SAVE SNAPSHOT " << savePath << endl;
+			return 0;
+		}
+		if (filenames.empty() && socketPath.empty())
+			return 0;
+	}
+
+	// --workers sets the number of threads, which is otherwise one per core
+	if (check)
+		return CheckFiles(filenames, nworkers > 0 ? nworkers : max(1u, thread::hardware_concurrency()), base.get());
+
+	if (!socketPath.empty()) {
+		ScriptServer server(limits, base);
+		if (!server.Serve(socketPath))
+			cout << "COULD NOT LISTEN ON " << socketPath << endl;
+		return 0;
+	}
+
+	if (nworkers > 0)
+		return RunScheduled(filenames, nworkers, quantum, limits, base);
+
+	if (filenames.size() > 1) {
 		cout << "TOO MANY FILENAMES" << endl;
 		return 0;
 	}
-	else if (argc == 2) {
-		string arg(argv[1]);
-		inFile.open(arg);
+	else if (filenames.size() == 1) {
+		inFile.open(filenames[0]);
 		if (!inFile.is_open()) {
-			cout << "COULD NOT OPEN " << arg << endl;
+			cout << "COULD NOT OPEN " << filenames[0] << endl;
 			return 0;
 		}
 		in = &inFile;
 	}
 
+	// in batch mode every column is a variable the program starts with
+	Columns columns;
+	vector<string> bound;
+	if (!batchPath.empty()) {
+		ifstream columnsFile(batchPath);
+		if (!columnsFile.is_open()) {
+			cout << "COULD NOT OPEN " << batchPath << endl;
+			return 0;
+		}
+		string error;
+		if (!ReadColumns(columnsFile, columns, error)) {
+			cout << "BAD COLUMNS FILE " << batchPath << " " << error << endl;
+			return 0;
+		}
+		for (auto& c : columns)
+			bound.push_back(c.first);
+	}
+
+	// a checkpoint is tied to the text of the program it was written for
+	string text;
+	istringstream textIn;
+	if (!checkpointPath.empty()) {
+		text.assign(istreambuf_iterator<char>(*in), istreambuf_iterator<char>());
+		textIn.str(text);
+		in = &textIn;
+	}
+
 	// Main program
 
-	int lineNumber = 0;
-	ParseTree *prog = Prog(*in, lineNumber);
-	if (prog == 0)
+	ParseTree *prog = Load(*in, base.get(), bound);
+	if (prog == 0) {
+		if (stats)
+			stats->Print(cerr, statsJson);
 		return 0;
+	}
+	if (stats)
+		stats->Measure(prog);
 
-	map<string,bool> declaredIdentifiers;
-	prog->CheckLetBeforeUse(declaredIdentifiers);
+	if (!checkpointPath.empty()) {
+		RunCheckpointed(prog, text, base, limits, checkpointPath, checkpointInterval, resume);
+		if (stats) {
+			cout.flush();
+			stats->Print(cerr, statsJson);
+		}
+		return 0;
+	}
 
-	if(declarationErrors > 0) {
+	if (!batchPath.empty()) {
+		budget = &limits;
+		limits.StartClock();
+		{
+			Stats::Phase unused;
+			PhaseTimer t(stats ? stats->run : unused);
+			RunBatches(prog, columns, batchSize, base, cout);
+		}
+		if (stats) {
+			cout.flush();
+			stats->Print(cerr, statsJson);
+		}
 		return 0;
 	}
 
-	map<string,Val> symbols;
-	try {
-		prog->Eval(symbols);
+	ParallelLets *pool = 0;
+	if (nparallel > 1)
+		parallelLets = pool = new ParallelLets(nparallel);
+
+	SymbolTable symbols(base);
+	budget = &limits;
+	limits.StartClock();
+	Val result;
+	{
+		Stats::Phase unused;
+		PhaseTimer t(stats ? stats->run : unused);
+		result = prog->Eval(symbols);
 	}
-	catch(string& e) {
-		cout << e << endl;
+	if (result.isErr())
+		cout << result.RuntimeError() << endl;
+
+	if (stats) {
+		stats->symbols = symbols.Local().size();
+		cout.flush();
+		stats->Print(cerr, statsJson);
 	}
+	parallelLets = 0;
+	delete pool;
 	return 0;
 }
-
-
@@ -0,0 +1,208 @@
+/*
+ * parallel.cpp
+ */
+
+#include "parallel.h"
+#include "budget.h"
+#include "stats.h"
+#include <unordered_map>
+#include <algorithm>
+using namespace std;
+
+ParallelLets *parallelLets = 0;
+
+Val RunParallelLets(ParallelLets *pool, ParseTree *list, SymbolTable& symbols, ParseTree *&rest) {
+	return pool->Run(list, symbols, rest);
+}
+
+ParallelLets::ParallelLets(int nthreads)
+		: jobs(0), next(0), done(0), generation(0), stopping(false) {
+	for (int i = 1; i < nthreads; i++)
+		workers.emplace_back(&ParallelLets::Work, this);
+}
+
+ParallelLets::~ParallelLets() {
+	{
+		lock_guard<mutex> l(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (thread& w : workers)
+		w.join();
+}
+
+// Claims and runs the next job of batch gen; false when there are none left
+bool ParallelLets::RunJob(unsigned gen) {
+	const function<void()> *job;
+	{
+		lock_guard<mutex> l(lock);
+		if (generation != gen || jobs == 0 || next >= jobs->size())
+			return false;
+		job = &(*jobs)[next++];
+	}
+	(*job)();
+	{
+		lock_guard<mutex> l(lock);
+		if (++done == jobs->size())
+			finished.notify_all();
+	}
+	return true;
+}
+
+void ParallelLets::Work() {
+	unsigned seen = 0;
+	unique_lock<mutex> l(lock);
+	while (true) {
+		wake.wait(l, [&] { return stopping || generation != seen; });
+		if (stopping)
+			return;
+		seen = generation;
+		l.unlock();
+		while (RunJob(seen))
+			;
+		l.lock();
+	}
+}
+
+// Runs every job in batch, on the pool and on the calling thread, and waits for them all
+void ParallelLets::RunAll(const vector<function<void()>>& batch) {
+	unsigned gen;
+	{
+		lock_guard<mutex> l(lock);
+		jobs = &batch;
+		next = 0;
+		done = 0;
+		gen = ++generation;
+	}
+	wake.notify_all();
+	while (RunJob(gen))
+		;
+	unique_lock<mutex> l(lock);
+	finished.wait(l, [&] { return done == batch.size(); });
+
+	// a worker may still be about to look for another job of this batch
+	// after the caller has gone on and destroyed it
+	jobs = 0;
+}
+
+// Collects the variables an expression reads, as interned names
+static void Reads(ParseTree *e, vector<const string*>& ids) {
+	if (e == 0)
+		return;
+	if (e->IsIdent()) {
+		ids.push_back(static_cast<Ident*>(e)->GetIdRef());
+		return;
+	}
+	Reads(e->Left(), ids);
+	Reads(e->Right(), ids);
+}
+
+Val ParallelLets::Run(ParseTree *list, SymbolTable& symbols, ParseTree *&rest) {
+	vector<ParseTree*> lets;
+	for (; list != 0 && list->Left()->IsLet(); list = list->Right())
+		lets.push_back(list->Left());
+
+	size_t n = lets.size();
+	size_t firstError = n;
+	Val error;
+
+	// fuel is charged in statement order before any let runs
+	for (size_t i = 0; i < n && firstError == n; i++) {
+		if (!budget->Tick()) {
+			firstError = i;
+			error = Val(budget->Reason()).At(lets[i]->GetLineNumber());
+		}
+	}
+
+	// a let runs one wave after the latest earlier let that writes what it
+	// reads, reads what it writes, or writes the same variable; the maps
+	// hold one more than the wave of that latest let; names come from one
+	// ConstPool, so they are keyed by pointer
+	vector<size_t> wave(n);
+	unordered_map<const string*,size_t> writeWave, readWave;
+	size_t nwaves = 0;
+	for (size_t i = 0; i < firstError; i++) {
+		vector<const string*> reads;
+		Reads(lets[i]->Left(), reads);
+		const string *id = static_cast<Let*>(lets[i])->GetIdRef();
+
+		size_t w = max(writeWave[id], readWave[id]);
+		for (const string *r : reads)
+			w = max(w, writeWave[r]);
+
+		wave[i] = w;
+		writeWave[id] = w + 1;
+		for (const string *r : reads)
+			readWave[r] = max(readWave[r], w + 1);
+		nwaves = max(nwaves, w + 1);
+	}
+
+	vector<vector<size_t>> waves(nwaves);
+	for (size_t i = 0; i < firstError; i++)
+		waves[wave[i]].push_back(i);
+
+	// a job burns fuel from a share of the caller's budget and counts its
+	// allocations apart; both are added to the caller's once its wave is
+	// done, in statement order
+	vector<Val> results(n);
+	vector<Budget> shares(n);
+	vector<Stats> counted(stats ? n : 0);
+	Budget *caller = budget;
+	Stats *callerStats = stats;
+
+	for (const vector<size_t>& members : waves) {
+		vector<function<void()>> batch;
+		long long left = caller->Left();
+		for (size_t k : members) {
+			if (k >= firstError)
+				break;
+			shares[k] = caller->Share();
+			batch.push_back([&, k] {
+				Budget *saved = budget;
+				Stats *savedStats = stats;
+				budget = &shares[k];
+				stats = callerStats ? &counted[k] : 0;
+				results[k] = lets[k]->Left()->Eval(symbols).Keep();
+				scratch.Reset();
+				budget = saved;
+				stats = savedStats;
+			});
+		}
+
+		if (batch.size() == 1)
+			batch[0]();
+		else
+			RunAll(batch);
+
+		for (size_t k : members) {
+			if (callerStats) {
+				callerStats->allocs += counted[k].allocs;
+				callerStats->allocBytes += counted[k].allocBytes;
+			}
+			if (k >= firstError)
+				break;
+			// the lets before k in this wave may have burned what k needed
+			long long burned = left < 0 ? 0 : left - shares[k].Left();
+			if (burned > 0 && !caller->Charge(burned)) {
+				firstError = k;
+				error = Val(caller->Reason()).At(lets[k]->GetLineNumber());
+				break;
+			}
+			if (results[k].isErr()) {
+				firstError = k;
+				error = results[k];
+				break;
+			}
+		}
+
+		// lets after the first error are never stored; sequential execution would not have reached them
+		for (size_t k : members) {
+			if (k >= firstError)
+				break;
+			symbols.Set(lets[k]->GetId(), results[k]);
+		}
+	}
+
+	rest = list;
+	return error;
+}
@@ -0,0 +1,54 @@
+/*
+ * parallel.h
+ */
+
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include "parsetree.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// ParallelLets evaluates a run of consecutive let statements concurrently.
+//
+// The lets are ordered by their read/write dependencies: a let waits for
+// an earlier let that writes a variable it reads, that reads the variable
+// it writes, or that writes the same variable.  Each wave of lets with no
+// dependencies between them is evaluated on the pool, and the results are
+// stored in statement order once the wave is done.  The runtime error
+// reported is the one sequential execution would have hit first.
+//
+// A let burns fuel from a share of the caller's Budget, never from the
+// Budget itself, which is not safe to share between threads.  The fuel
+// each let burned is charged to the caller in statement order after the
+// wave, so a wave that needs more fuel than is left fails at the same let
+// a sequential run would.
+class ParallelLets {
+	std::vector<std::thread>	workers;
+	std::mutex					lock;
+	std::condition_variable		wake;
+	std::condition_variable		finished;
+
+	const std::vector<std::function<void()>> *jobs;	// null between batches
+	size_t						next;
+	size_t						done;
+	unsigned					generation;
+	bool						stopping;
+
+	void Work();
+	bool RunJob(unsigned gen);
+	void RunAll(const std::vector<std::function<void()>>& batch);
+
+public:
+	// nthreads counts the calling thread, which also runs jobs
+	ParallelLets(int nthreads);
+	~ParallelLets();
+
+	// evaluates the lets at the head of list and sets rest to the rest of
+	// the list; returns the first error in statement order, if any
+	Val Run(ParseTree *list, SymbolTable& symbols, ParseTree *&rest);
+};
+
+#endif /* PARALLEL_H_ */
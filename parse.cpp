@@ -6,19 +6,62 @@
 #include "parsetree.h"
 #include "lex.h"
 #include "val.h"
+#include "stats.h"
 using namespace std;
 
+// The parser's state is per thread, so that several threads can parse
+// programs at once
 namespace Parser {
 
-	bool pushed_back = false;
-	Lex	pushed_token;
+	thread_local bool pushed_back = false;
+	thread_local Lex	pushed_token;
+
+	// the last token read, to know where a syntax error left off
+	thread_local Lex	last_token;
+
+	// literals and identifiers of the program being parsed
+	thread_local ConstPoolRef pool;
+
+	// when set, tokens are read from here instead of being lexed from in
+	thread_local const Lex *replay = 0;
+	thread_local const Lex *replayEnd = 0;
+
+	// when set, syntax errors go here instead of to cout
+	thread_local vector<SyntaxError> *errors = 0;
+
+	// when set, a statement list goes on past a statement with an error
+	thread_local bool recover = false;
+
+	// BEGINs read less ENDs read
+	thread_local int depth = 0;
+
+	static Lex LexToken(istream& in, int& line) {
+		if (replay) {
+			if (replay == replayEnd)
+				return Lex(DONE, "", line);
+			line = replay->GetLinenum();
+			return *replay++;
+		}
+		if (stats) {
+			PhaseTimer t(stats->lex);
+			stats->tokens++;
+			return getNextToken(in, line);
+		}
+		return getNextToken(in, line);
+	}
 
 	static Lex GetNextToken(istream& in, int& line) {
 		if (pushed_back) {
 			pushed_back = false;
-			return pushed_token;
+			last_token = pushed_token;
 		}
-		return getNextToken(in, line);
+		else
+			last_token = LexToken(in, line);
+		if (last_token == BEGIN)
+			depth++;
+		else if (last_token == END)
+			depth--;
+		return last_token;
 	}
 
 	static void PushBackToken(Lex& t) {
@@ -27,19 +70,60 @@ namespace Parser {
 		}
 		pushed_back = true;
 		pushed_token = t;
+		if (t == BEGIN)
+			depth--;
+		else if (t == END)
+			depth++;
+	}
+
+	// After a syntax error in a statement that started at depth base,
+	// skips the rest of it: up to and past its semicolon, or up to the END
+	// of the list it is in or the end of the program
+	static void Skip(istream& in, int& line, int base) {
+		Lex t = last_token;
+		if (!pushed_back) {
+			if (t == SC && depth == base)
+				return;
+			if (t == DONE || (t == END && depth < base)) {
+				PushBackToken(t);
+				return;
+			}
+		}
+		while (true) {
+			t = GetNextToken(in, line);
+			if (t == DONE || (t == END && depth < base)) {
+				PushBackToken(t);
+				return;
+			}
+			if (t == SC && depth == base)
+				return;
+		}
 	}
 }
 
-static int error_count = 0;
+static thread_local int error_count = 0;
+
+ostream& operator<<(ostream& out, const SyntaxError& e) {
+	out << e.line << ": " << e.msg;
+	return out;
+}
 
 void ParseError(int line, string msg) {
 	++error_count;
-	cout << line << ": " << msg << endl;
+	if (Parser::errors)
+		Parser::errors->push_back(SyntaxError(line, msg));
+	else
+		cout << SyntaxError(line, msg) << endl;
 }
 
 // Program is a Statement List
 ParseTree *Prog(istream& in, int& line) {
+	error_count = 0;
+	Parser::pushed_back = false;
+	Parser::depth = 0;
+	Parser::pool = make_shared<ConstPool>();
 	ParseTree *sl = Slist(in, line);
+	Parser::pool.reset();
 	if (sl == 0) {
 		ParseError(line, "Prog Error: No \"Slist\"");
 	}
@@ -49,6 +133,118 @@ ParseTree *Prog(istream& in, int& line) {
 	return sl;
 }
 
+// Parses a program the way Prog does, with the syntax errors put in
+// errors instead of printed
+ParseTree *Prog(istream& in, int& line, vector<SyntaxError>& errors) {
+	Parser::errors = &errors;
+	ParseTree *prog = Prog(in, line);
+	Parser::errors = 0;
+	return prog;
+}
+
+// Parses a program the way Prog does, but goes on past a syntax error at
+// the end of the statement that has it, so that one pass finds every
+// error.  The errors are put in errors, not printed, and what did parse
+// is returned, or null if nothing did.
+ParseTree *RecoverProg(istream& in, int& line, vector<SyntaxError>& errors) {
+	error_count = 0;
+	Parser::pushed_back = false;
+	Parser::depth = 0;
+	Parser::pool = make_shared<ConstPool>();
+	Parser::errors = &errors;
+	Parser::recover = true;
+
+	ParseTree *sl = Slist(in, line);
+	if (sl == 0) {
+		ParseError(line, "Prog Error: No \"Slist\"");
+	}
+
+	// Prog stops quietly at an END outside any BEGIN, and the rest of the
+	// program never runs
+	while (Parser::GetNextToken(in, line) == END) {
+		ParseError(line, "Slist Error: \"END\" without \"BEGIN\"");
+		ParseTree *rest = Slist(in, line);
+		if (sl == 0)
+			sl = rest;
+		else {
+			ParseTree *tail = sl;
+			while (tail->Right())
+				tail = tail->Right();
+			static_cast<StmtList*>(tail)->SetRight(rest);
+		}
+	}
+
+	Parser::pool.reset();
+	Parser::errors = 0;
+	Parser::recover = false;
+	return sl;
+}
+
+namespace Parser {
+	static void StartReplay(const Lex *first, const Lex *last, const ConstPoolRef& tokenPool) {
+		pushed_back = false;
+		depth = 0;
+		pool = tokenPool;
+		replay = first;
+		replayEnd = last;
+	}
+
+	static void EndReplay() {
+		replay = 0;
+		pushed_back = false;
+		pool.reset();
+		errors = 0;
+	}
+}
+
+// Parses the statement at the head of tokens, and the semicolon after it,
+// the way Slist does, from tokens that were lexed earlier
+ParseTree *ReplayStmt(const Lex *first, const Lex *last, const ConstPoolRef& pool, int& line, bool& ended) {
+	Parser::StartReplay(first, last, pool);
+	vector<SyntaxError> unused;
+	Parser::errors = &unused;
+	int errors = error_count;
+
+	// the stream is never read while tokens are being replayed
+	istream& in = cin;
+	Lex t = Parser::GetNextToken(in, line);
+	while (t == SC)
+		t = Parser::GetNextToken(in, line);
+	Parser::PushBackToken(t);
+	ParseTree *s = Stmt(in, line);
+	if (s != 0) {
+		t = Parser::GetNextToken(in, line);
+		if (t != SC) {
+			Parser::PushBackToken(t);
+			ParseError(line, "Slist Error: Missing \"SC\" after \"Stmt\"");
+		}
+	}
+
+	// a statement list inside can stop at an error and still give a tree
+	if (error_count != errors) {
+		delete s;
+		s = 0;
+	}
+	ended = (s == 0 && error_count == errors);
+
+	Parser::EndReplay();
+	return s;
+}
+
+// Finds the syntax errors that Slist, or Prog if first is the start of
+// the program, reports from tokens that were lexed earlier
+void ReplayErrors(const Lex *first, const Lex *last, const ConstPoolRef& pool, int& line, bool start,
+		vector<SyntaxError>& errors) {
+	Parser::StartReplay(first, last, pool);
+	Parser::errors = &errors;
+	istream& in = cin;
+	ParseTree *sl = Slist(in, line);
+	if (sl == 0 && start)
+		ParseError(line, "Prog Error: No \"Slist\"");
+	delete sl;
+	Parser::EndReplay();
+}
+
 //  Statement List is a Semicoln followed by zero or more Statement Lists OR
 //  a Statement followed by a semicoln followed by zero or more Statement Lists
 ParseTree *Slist(istream& in, int& line) {
@@ -57,14 +253,25 @@ ParseTree *Slist(istream& in, int& line) {
 		return Slist(in, line);
     }
 	Parser::PushBackToken(t);
+	int errors = error_count;
+	int depth = Parser::depth;
 	ParseTree *s = Stmt(in, line);
 	if (s == 0) {
+		if (Parser::recover && error_count != errors) {
+			Parser::Skip(in, line, depth);
+			return Slist(in, line);
+		}
 		return 0;
 	}
 	t = Parser::GetNextToken(in, line);
 	if (t != SC) {
         Parser::PushBackToken(t);
 		ParseError(line, "Slist Error: Missing \"SC\" after \"Stmt\"");
+		if (Parser::recover) {
+			delete s;
+			Parser::Skip(in, line, depth);
+			return Slist(in, line);
+		}
 		return 0;
 	}
 	return new StmtList(s, Slist(in, line));
@@ -117,12 +324,13 @@ ParseTree *IfStmt(istream& in, int& line) {
 
 // Print Statement is a PRINT followed by a Expression
 ParseTree *PrintStmt(istream& in, int& line) {
+	int firstLine = line;
 	ParseTree *ex = Expr(in, line);
 	if (ex == 0) {
 		ParseError(line, "PrintStmt Error: Missing \"Expr\" after \"PRINT\"");
 		return 0;
 	}
-	return new Print(ex);
+	return new Print(firstLine, ex);
 }
 
 // Let Statement is a LET followed by a Identifier followed by a Expression
@@ -137,7 +345,7 @@ ParseTree *LetStmt(istream& in, int& line) {
 		ParseError(line, "LetStmt Error: Missing \"Expr\" after \"LET ID\"");
 		return 0;
 	}
-	return new Let(t, ex);
+	return new Let(t, ex, Parser::pool);
 }
 
 // Loop Statement is a LOOP followed by a Expression followed by a BEGIN followed by a Statement List followed by a END
@@ -238,11 +446,16 @@ ParseTree *Rev(istream& in, int& line) {
 ParseTree *Primary(istream& in, int& line) {
 	Lex t = Parser::GetNextToken(in, line);
 	if (t == ID)
-		return new Ident(t);
-	else if (t == INT)
+		return new Ident(t, Parser::pool);
+	else if (t == INT) {
+		if (!IConst::Fits(t.GetLexeme())) {
+			ParseError(line, "Primary Error: Integer constant out of range");
+			return 0;
+		}
 		return new IConst(t);
+	}
 	else if (t == STR)
-		return new SConst(t);
+		return new SConst(t, Parser::pool);
 	else if (t == LPAREN) {
 		ParseTree *ex = Expr(in, line);
 		if (ex == 0) {
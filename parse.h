@@ -6,12 +6,27 @@
 #define PARSE_H_
 
 #include <iostream>
+#include <vector>
 using namespace std;
 
 #include "lex.h"
 #include "parsetree.h"
 
+// A syntax error, printed as Prog prints it
+class SyntaxError {
+public:
+	int		line;
+	string	msg;
+
+	SyntaxError(int line, const string& msg) : line(line), msg(msg) {}
+};
+
+extern ostream& operator<<(ostream& out, const SyntaxError& e);
+
 extern ParseTree *Prog(istream& in, int& line);
+
+// Parses like Prog, with the syntax errors collected in errors
+extern ParseTree *Prog(istream& in, int& line, vector<SyntaxError>& errors);
 extern ParseTree *Slist(istream& in, int& line);
 extern ParseTree *Stmt(istream& in, int& line);
 extern ParseTree *IfStmt(istream& in, int& line);
@@ -23,4 +38,19 @@ extern ParseTree *Prod(istream& in, int& line);
 extern ParseTree *Rev(istream& in, int& line);
 extern ParseTree *Primary(istream& in, int& line);
 
+// Parses like Prog, but recovers from each syntax error at the next
+// semicolon or END and collects every error in errors instead of
+// printing it.  Returns the statements that parsed.
+extern ParseTree *RecoverProg(istream& in, int& line, vector<SyntaxError>& errors);
+
+// Parses one top-level statement from tokens lexed earlier, reading no
+// further than last, with nodes interned in pool.  Returns null if there
+// is no statement there, setting ended, or if it has a syntax error.
+extern ParseTree *ReplayStmt(const Lex *first, const Lex *last, const ConstPoolRef& pool, int& line, bool& ended);
+
+// Finds the syntax errors Slist would report from first on, and those of
+// Prog if first starts the program
+extern void ReplayErrors(const Lex *first, const Lex *last, const ConstPoolRef& pool, int& line, bool start,
+		vector<SyntaxError>& errors);
+
 #endif /* PARSE_H_ */
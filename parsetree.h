@@ -5,9 +5,13 @@
 #ifndef PARSETREE_H_
 #define PARSETREE_H_
 
+#include "lex.h"
 #include "val.h"
+#include "symtab.h"
+#include "pool.h"
 #include <vector>
 #include <map>
+#include <limits>
 using std::vector;
 using std::map;
 
@@ -17,7 +21,19 @@ enum NodeType { ERRTYPE, INTTYPE, STRTYPE };
 // a "forward declaration" for a class to hold values
 class Value;
 
-static int declarationErrors = 0;
+// batch mode evaluates a node for many rows at once; see batch.h
+class Batch;
+class Column;
+typedef vector<unsigned char> Mask;
+
+// the stream Print writes to on this thread; a Task points it at its own buffer
+extern thread_local ostream *output;
+
+// set by the driver when independent lets may be evaluated concurrently
+class ParseTree;
+class ParallelLets;
+extern ParallelLets *parallelLets;
+extern Val RunParallelLets(ParallelLets *pool, ParseTree *list, SymbolTable& symbols, ParseTree *&rest);
 
 class ParseTree {
 protected:
@@ -34,6 +50,18 @@ public:
 	}
 
 	int GetLineNumber() const { return linenum; }
+	ParseTree *Left() const { return left; }
+	ParseTree *Right() const { return right; }
+
+	// moves every statement and expression in the tree down by delta lines
+	void ShiftLines(int delta) {
+		if (!IsStmtList())
+			linenum += delta;
+		if (left)
+			left->ShiftLines(delta);
+		if (right)
+			right->ShiftLines(delta);
+	}
 
 	int MaxDepth() const {
 		int depth = 0;
@@ -47,10 +75,24 @@ public:
 
 	virtual bool IsIdent() const { return false; }
 	virtual bool IsVar() const { return false; }
-	virtual string GetId() const { return ""; }
+	virtual const string& GetId() const {
+		static const string none;
+		return none;
+	}
     virtual int IsBang() const { return 0; }
     virtual bool IsLet() const { return false; }
-    virtual Val Eval(map<string,Val>& symbols) = 0;
+    virtual bool IsStmtList() const { return false; }
+    virtual bool IsIf() const { return false; }
+    virtual bool IsLoop() const { return false; }
+    virtual const char *ClassName() const = 0;
+
+    // Eval returns the value of an expression, an empty Val for a
+    // statement that ran to completion, or the error that stopped it
+    virtual Val Eval(SymbolTable& symbols) = 0;
+
+    // EvalBatch evaluates the node for the rows of mask in a batch; a
+    // statement returns an empty Column
+    virtual Column EvalBatch(Batch& batch, const Mask& mask) = 0;
 
 	int BangCount() const {
 		int bangCount = 0;
@@ -61,85 +103,76 @@ public:
 		bangCount += IsBang();
 		return bangCount;
 	}
-
-	int CheckLetBeforeUse(map<string,bool>& var) {
-		if (left) {
-			if (left->IsLet()) {
-				if (left->left->IsIdent()) {
-					if (var.find(left->left->GetId()) == var.end()) {
-						cout << "UNDECLARED VARIABLE " << left->left->GetId() << endl;
-						declarationErrors++;
-					}
-				}
-				var[left->GetId()] = true;
-			}
-			if (left->IsIdent()) {
-				if (var.find(left->GetId()) == var.end()) {
-					cout << "UNDECLARED VARIABLE " << left->GetId() << endl;
-					declarationErrors++;
-				}
-			}
-			left->CheckLetBeforeUse(var);
-		}
-		if (right) {
-			if (right->IsLet()) {
-				if (right->left->IsIdent()) {
-					if (var.find(right->left->GetId()) == var.end()) {
-						cout << "UNDECLARED VARIABLE " << right->left->GetId() << endl;
-						declarationErrors++;
-					}
-				}
-				var[right->GetId()] = true;
-			}
-			if (right->IsIdent()) {
-				if (var.find(right->GetId()) == var.end()) {
-					cout << "UNDECLARED VARIABLE " << right->GetId() << endl;
-					declarationErrors++;
-				}
-			}
-			right->CheckLetBeforeUse(var);
-		}
-		return declarationErrors;
-	}
-
-	void runtime_err(int line, string msg) {
-		string lineStr = to_string(line);
-		throw "RUNTIME ERROR at " + lineStr + ": " + msg;
-	}
 };
 
 class StmtList : public ParseTree {
 public:
 	StmtList(ParseTree *l, ParseTree *r) : ParseTree(0, l, r) {}
 
-	Val Eval(map<string,Val>& symbols) override {
-		left->Eval(symbols);
-		if (right)
-			right->Eval(symbols);
-		return Val();
+	const char *ClassName() const { return "StmtList"; }
+
+	bool IsStmtList() const { return true; }
+
+	// relinks the rest of the list; the old rest is not deleted
+	void SetRight(ParseTree *r) { right = r; }
+
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
+		if (parallelLets && left->IsLet() && right && right->Left()->IsLet()) {
+			ParseTree *rest;
+			Val R = RunParallelLets(parallelLets, this, symbols, rest);
+			if (R.isErr() || rest == 0)
+				return R;
+			return rest->Eval(symbols);
+		}
+		if (!budget->Tick())
+			return Val(budget->Reason()).At(left->GetLineNumber());
+		Val L = left->Eval(symbols);
+		if (L.isErr() || right == 0)
+			return L;
+		return right->Eval(symbols);
 	}
 };
 
 class Let : public ParseTree {
-	string id;
+	ConstPoolRef pool;
+	const string *id;
 public:
-	Let(Lex& t, ParseTree *e) : ParseTree(t.GetLinenum(), e), id(t.GetLexeme()) {}
+	Let(Lex& t, ParseTree *e, const ConstPoolRef& pool) : ParseTree(t.GetLinenum(), e), pool(pool), id(pool->Intern(t.GetLexeme())) {}
+
+	const char *ClassName() const { return "Let"; }
 
-	string GetId() const { return id; }
+	const string& GetId() const { return *id; }
+	const string *GetIdRef() const { return id; }
 	bool IsLet() const { return true; }
 
-	Val Eval(map<string,Val>& symbols) override {
-		symbols[id] = left->Eval(symbols);
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
+		Val L = left->Eval(symbols);
+		if (L.isErr())
+			return L;
+		symbols.Set(*id, L.Keep());
+		scratch.Reset();
 		return Val();
 	}
 };
 
 class Print : public ParseTree {
 public:
-	Print(ParseTree *l) : ParseTree(0, l) {}
+	Print(int line, ParseTree *l) : ParseTree(line, l) {}
+
+	const char *ClassName() const { return "Print"; }
 
-	Val Eval(map<string,Val>& symbols) override {
-		cout << left->Eval(symbols);
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
+		Val L = left->Eval(symbols);
+		if (L.isErr())
+			return L;
+		*output << L;
+		scratch.Reset();
 		return Val();
 	}
 };
@@ -148,21 +181,31 @@ class Loop : public ParseTree {
 public:
 	Loop(int line, ParseTree *l, ParseTree *r) : ParseTree(line, l, r) {}
 
-	Val Eval(map<string,Val>& symbols) override {
+	const char *ClassName() const { return "Loop"; }
+
+	bool IsLoop() const { return true; }
+
+	// evaluates the loop condition; an error unless it is an integer
+	Val Test(SymbolTable& symbols) {
 		Val L = left->Eval(symbols);
-		if (L.isErr())
-			runtime_err(linenum, "Testing 1");
-		if (L.isStr())
-			runtime_err(linenum, "LoopStmt expression evaluates to string type");
-		while (L.ValInt() != 0) {
+		if (!L.isInt())
+			return (L.isErr() ? L : Val(ERR_LOOP_STRING)).At(linenum);
+		return L;
+	}
+
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
+		while (true) {
+			Val L = Test(symbols);
+			if (L.isErr() || L.ValInt() == 0)
+				return L.isErr() ? L : Val();
+			if (!budget->Tick())
+				return Val(budget->Reason()).At(linenum);
 			Val R = right->Eval(symbols);
-			L = left->Eval(symbols);
-			if (L.isErr())
-				runtime_err(linenum, "Testing 3");
-			if (L.isStr())
-				runtime_err(linenum, "LoopStmt expression evaluates to string type");
+			if (R.isErr())
+				return R;
 		}
-		return Val();
 	}
 };
 
@@ -170,16 +213,25 @@ class If : public ParseTree {
 public:
 	If(int line, ParseTree *l, ParseTree *r) : ParseTree(line, l, r) {}
 
-	Val Eval(map<string,Val>& symbols) override {
+	const char *ClassName() const { return "If"; }
+
+	bool IsIf() const { return true; }
+
+	// evaluates the condition; an error unless it is an integer
+	Val Test(SymbolTable& symbols) {
 		Val L = left->Eval(symbols);
-	    if (L.isErr())
-	    	runtime_err(linenum, L.GetErrMsg());
-	    if (L.isStr())
-	    	runtime_err(linenum, "Expression is not an integer");
-	    if (L.ValInt() == 0)
-			return Val();
-	    Val R = right->Eval(symbols);
-	    return Val();
+	    if (!L.isInt())
+	    	return (L.isErr() ? L : Val(ERR_IF_STRING)).At(linenum);
+	    return L;
+	}
+
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
+		Val L = Test(symbols);
+	    if (L.isErr() || L.ValInt() == 0)
+	    	return L.isErr() ? L : Val();
+	    return right->Eval(symbols);
 	}
 };
 
@@ -188,16 +240,16 @@ class PlusExpr : public ParseTree {
 public:
 	PlusExpr(int line, ParseTree *l, ParseTree *r) : ParseTree(line, l, r) {}
 
-	Val Eval(map<string,Val>& symbols) override {
+	const char *ClassName() const { return "PlusExpr"; }
+
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
 		Val L = left->Eval(symbols);
-	    if (L.isErr())
-	    	runtime_err(linenum, L.GetErrMsg());
 	    Val R = right->Eval(symbols);
-	    if (R.isErr())
-	    	runtime_err(linenum, R.GetErrMsg());
 	    Val answer = L + R;
 	    if (answer.isErr())
-	    	runtime_err(linenum, answer.GetErrMsg());
+	    	answer.At(linenum);
 	    return answer;
 	}
 };
@@ -206,16 +258,16 @@ class MinusExpr : public ParseTree {
 public:
 	MinusExpr(int line, ParseTree *l, ParseTree *r) : ParseTree(line, l, r) {}
 
-	Val Eval(map<string,Val>& symbols) override {
+	const char *ClassName() const { return "MinusExpr"; }
+
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
 		Val L = left->Eval(symbols);
-	    if (L.isErr())
-	    	runtime_err(linenum, L.GetErrMsg());
 	    Val R = right->Eval(symbols);
-	    if (R.isErr())
-	    	runtime_err(linenum, R.GetErrMsg());
 	    Val answer = L - R;
 	    if (answer.isErr())
-	    	runtime_err(linenum, answer.GetErrMsg());
+	    	answer.At(linenum);
 	    return answer;
 	}
 };
@@ -224,16 +276,16 @@ class TimesExpr : public ParseTree {
 public:
 	TimesExpr(int line, ParseTree *l, ParseTree *r) : ParseTree(line, l, r) {}
 
-	Val Eval(map<string,Val>& symbols) override {
+	const char *ClassName() const { return "TimesExpr"; }
+
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
 		Val L = left->Eval(symbols);
-	    if (L.isErr())
-	    	runtime_err(linenum, L.GetErrMsg());
 	    Val R = right->Eval(symbols);
-	    if (R.isErr())
-	    	runtime_err(linenum, R.GetErrMsg());
 	    Val answer = L * R;
 	    if (answer.isErr())
-	    	runtime_err(linenum, answer.GetErrMsg());
+	    	answer.At(linenum);
 	    return answer;
 	}
 };
@@ -242,16 +294,16 @@ class DivideExpr : public ParseTree {
 public:
 	DivideExpr(int line, ParseTree *l, ParseTree *r) : ParseTree(line, l, r) {}
 
-	Val Eval(map<string,Val>& symbols) override {
+	const char *ClassName() const { return "DivideExpr"; }
+
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
 		Val L = left->Eval(symbols);
-	    if (L.isErr())
-	    	runtime_err(linenum, L.GetErrMsg());
 	    Val R = right->Eval(symbols);
-	    if (R.isErr())
-	    	runtime_err(linenum, R.GetErrMsg());
 	    Val answer = L / R;
 	    if (answer.isErr())
-	    	runtime_err(linenum, answer.GetErrMsg());
+	    	answer.At(linenum);
 	    return answer;
 	}
 };
@@ -260,15 +312,16 @@ class BangExpr : public ParseTree {
 public:
 	BangExpr(int line, ParseTree *l) : ParseTree(line, l) {}
 
+	const char *ClassName() const { return "BangExpr"; }
+
 	int IsBang() const { return 1; }
 
-	Val Eval(map<string,Val>& symbols) override {
-		Val L = left->Eval(symbols);
-	    if (L.isErr())
-	    	runtime_err(linenum, L.GetErrMsg());
-	    Val answer = !L;
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
+	    Val answer = !left->Eval(symbols);
 	    if (answer.isErr())
-	    	runtime_err(linenum, answer.GetErrMsg());
+	    	answer.At(linenum);
 	    return answer;
 	}
 };
@@ -279,32 +332,66 @@ public:
 	IConst(Lex& t) : ParseTree(t.GetLinenum()) {
 		val = stoi(t.GetLexeme());
 	}
-	Val Eval(map<string,Val>& symbols) override {
+
+	const char *ClassName() const { return "IConst"; }
+
+	// true if an INT lexeme can be held by an IConst
+	static bool Fits(const string& lexeme) {
+		size_t digits = lexeme.find_first_not_of('0');
+		if (digits == string::npos)
+			return true;
+		string max = to_string(numeric_limits<int>::max());
+		size_t len = lexeme.length() - digits;
+		return len < max.length() || (len == max.length() && lexeme.compare(digits, len, max) <= 0);
+	}
+
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
 		return Val(val);
 	}
 };
 
+// A string literal evaluates to a Val that points into the program's
+// ConstPool, so evaluating it never allocates
 class SConst : public ParseTree {
-	string val;
+	ConstPoolRef pool;
+	const string *val;
 public:
-	SConst(Lex& t) : ParseTree(t.GetLinenum()) {
-		val = t.GetLexeme();
-	}
-	Val Eval(map<string,Val>& symbols) override {
-		return Val(val);
+	SConst(Lex& t, const ConstPoolRef& pool) : ParseTree(t.GetLinenum()), pool(pool), val(pool->Intern(t.GetLexeme())) {}
+
+	const char *ClassName() const { return "SConst"; }
+
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
+		return Val::Ref(val);
 	}
 };
 
 class Ident : public ParseTree {
-	string id;
+	ConstPoolRef pool;
+	const string *id;
+	bool assigned;		// set by CheckAssignments when every path assigns id first
 public:
-	Ident(Lex& t) : ParseTree(t.GetLinenum()), id(t.GetLexeme()) {}
+	Ident(Lex& t, const ConstPoolRef& pool) : ParseTree(t.GetLinenum()), pool(pool), id(pool->Intern(t.GetLexeme())), assigned(false) {}
 
-	bool IsIdent() const { return true; }
-	string GetId() const { return id; }
+	const char *ClassName() const { return "Ident"; }
 
-	Val Eval(map<string,Val>& symbols) override {
-		return symbols[id];
+	bool IsIdent() const { return true; }
+	const string& GetId() const { return *id; }
+	const string *GetIdRef() const { return id; }
+	void SetAssigned(bool a) { assigned = a; }
+
+	Column EvalBatch(Batch& batch, const Mask& mask) override;
+
+	Val Eval(SymbolTable& symbols) override {
+		if (assigned)
+			return symbols.At(*id);
+		Val v;
+		if (!symbols.Get(*id, v))
+			return Val(ERR_UNSET_VARIABLE, *id).At(linenum);
+		return v;
 	}
 };
 
@@ -0,0 +1,31 @@
+/*
+ * pool.h
+ */
+
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <string>
+#include <unordered_set>
+#include <memory>
+using std::string;
+
+// ConstPool holds one copy of every string literal and identifier in a
+// program.  Strings never move once interned, so nodes and Vals can point
+// at them, and two identifiers from the same program are the same
+// variable exactly when their pointers are equal.  Every node that points
+// into the pool holds a reference to it, so it lives as long as the tree.
+class ConstPool {
+	std::unordered_set<string> strings;
+
+public:
+	const string *Intern(const string& s) {
+		return &*strings.insert(s).first;
+	}
+
+	size_t Size() const { return strings.size(); }
+};
+
+typedef std::shared_ptr<ConstPool> ConstPoolRef;
+
+#endif /* POOL_H_ */
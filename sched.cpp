@@ -0,0 +1,135 @@
+/*
+ * sched.cpp
+ */
+
+#include "sched.h"
+using namespace std;
+
+thread_local ostream *output = &cout;
+
+// Executes the frame on top of the stack: a statement list is split into
+// its first statement and the rest, a Loop or If tests its condition and
+// pushes its body, and any other statement is evaluated in one go.
+// Returns the error that stopped the program, if any.
+Val Task::Step() {
+	ParseTree *node = stack.back().node;
+	if (node->IsStmtList()) {
+		stack.pop_back();
+		if (!budget->Tick())
+			return Val(budget->Reason()).At(node->Left()->GetLineNumber());
+		if (node->Right())
+			stack.push_back({node->Right(), false});
+		stack.push_back({node->Left(), false});
+	}
+	else if (node->IsLoop()) {
+		Val L = static_cast<Loop*>(node)->Test(symbols);
+		if (L.isErr())
+			return L;
+		if (L.ValInt() == 0) {
+			stack.pop_back();
+			return Val();
+		}
+		if (!budget->Tick())
+			return Val(budget->Reason()).At(node->GetLineNumber());
+		stack.back().looped = true;
+		stack.push_back({node->Right(), false});
+	}
+	else if (node->IsIf()) {
+		stack.pop_back();
+		Val L = static_cast<If*>(node)->Test(symbols);
+		if (L.isErr())
+			return L;
+		if (L.ValInt() != 0)
+			stack.push_back({node->Right(), false});
+	}
+	else {
+		stack.pop_back();
+		return node->Eval(symbols);
+	}
+	return Val();
+}
+
+bool Task::Run(chrono::microseconds quantum) {
+	if (done)
+		return true;
+	if (!started) {
+		limits.StartClock();
+		started = true;
+	}
+
+	Budget *savedBudget = budget;
+	ostream *savedOutput = output;
+	budget = &limits;
+	output = &out;
+
+	// the clock is only read on every 16th back-edge
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int backEdges = 0;
+	while (!stack.empty()) {
+		if (stack.back().looped && (++backEdges & 15) == 0
+				&& chrono::steady_clock::now() - start >= quantum)
+			break;
+		Val R = Step();
+		if (R.isErr()) {
+			out << R.RuntimeError() << endl;
+			stack.clear();
+		}
+	}
+
+	budget = savedBudget;
+	output = savedOutput;
+	done = stack.empty();
+	return done;
+}
+
+Scheduler::Scheduler(int nworkers, chrono::microseconds quantum)
+		: quantum(quantum), pending(0), stopping(false) {
+	for (int i = 0; i < nworkers; i++)
+		workers.emplace_back(&Scheduler::Work, this);
+}
+
+Scheduler::~Scheduler() {
+	{
+		lock_guard<mutex> l(lock);
+		stopping = true;
+	}
+	ready.notify_all();
+	for (thread& w : workers)
+		w.join();
+}
+
+void Scheduler::Submit(Task *t) {
+	{
+		lock_guard<mutex> l(lock);
+		queue.push_back(t);
+		pending++;
+	}
+	ready.notify_one();
+}
+
+void Scheduler::Wait() {
+	unique_lock<mutex> l(lock);
+	idle.wait(l, [this] { return pending == 0; });
+}
+
+// Worker loop: run the Task at the head of the queue for one quantum and
+// requeue it at the tail if it has not finished
+void Scheduler::Work() {
+	unique_lock<mutex> l(lock);
+	while (true) {
+		ready.wait(l, [this] { return stopping || !queue.empty(); });
+		if (queue.empty())
+			return;
+		Task *t = queue.front();
+		queue.pop_front();
+
+		l.unlock();
+		bool finished = t->Run(quantum);
+		l.lock();
+
+		if (!finished)
+			queue.push_back(t);
+		else if (--pending == 0)
+			idle.notify_all();
+	}
+}
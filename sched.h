@@ -0,0 +1,98 @@
+/*
+ * sched.h
+ */
+
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include "parsetree.h"
+#include "budget.h"
+#include <sstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+using std::ostringstream;
+using std::deque;
+
+// A Task is one run of a program that can be suspended and resumed.
+//
+// Statements are executed from an explicit stack instead of the native
+// C++ stack, so a Task can give up its thread at any loop back-edge.
+// Expressions have no loops in them and are still evaluated with Eval.
+// Each Task owns its symbol table, its output buffer and its Budget;
+// Tasks started from the same Snapshot share it.
+class Task {
+public:
+	struct Frame {
+		ParseTree	*node;
+		bool		looped;		// for a Loop: the body has run at least once
+	};
+
+private:
+	ParseTree		*prog;
+	vector<Frame>	stack;
+	SymbolTable		symbols;
+	ostringstream	out;
+	bool			started;
+	bool			done;
+
+	Val Step();
+
+public:
+	// the limits of this run; a timeout counts from the first Run
+	Budget			limits;
+
+	// base, if given, holds the variables the program starts with
+	Task(ParseTree *prog, const SnapshotRef& base = SnapshotRef()) : prog(prog), symbols(base), started(false), done(false) {
+		stack.push_back({prog, false});
+	}
+
+	// sets the initial value of a variable before the first Run
+	void Bind(const string& id, const Val& v) { symbols.Set(id, v); }
+
+	// runs until the program ends or the quantum is used up at a loop
+	// back-edge; true once the program has finished
+	bool Run(std::chrono::microseconds quantum);
+
+	bool Done() const { return done; }
+	string Output() const { return out.str(); }
+
+	// removes and returns the output buffered so far
+	string TakeOutput() {
+		string s = out.str();
+		out.str("");
+		return s;
+	}
+
+	// the state a Checkpoint saves and restores, only to be touched between Runs
+	vector<Frame>& Stack() { return stack; }
+	SymbolTable& Symbols() { return symbols; }
+};
+
+// The Scheduler multiplexes Tasks onto a fixed set of worker threads.
+// A Task that uses up its quantum goes to the back of the run queue.
+class Scheduler {
+	vector<std::thread>			workers;
+	deque<Task*>				queue;
+	std::mutex					lock;
+	std::condition_variable		ready;
+	std::condition_variable		idle;
+	std::chrono::microseconds	quantum;
+	int							pending;
+	bool						stopping;
+
+	void Work();
+
+public:
+	Scheduler(int nworkers, std::chrono::microseconds quantum);
+	~Scheduler();
+
+	void Submit(Task *t);
+
+	// blocks until every submitted Task has finished
+	void Wait();
+};
+
+#endif /* SCHED_H_ */
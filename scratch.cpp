@@ -0,0 +1,57 @@
+/*
+ * scratch.cpp
+ */
+
+#include "scratch.h"
+#include "stats.h"
+#include <cstdlib>
+#include <new>
+using namespace std;
+
+thread_local Scratch scratch;
+
+Scratch::~Scratch() {
+	for (Chunk& c : chunks)
+		free(c.data);
+}
+
+// Moves on to the next chunk that can hold n bytes, adding one if there is none
+char *Scratch::Grow(size_t n) {
+	if (!chunks.empty())
+		current++;
+	while (current < chunks.size() && chunks[current].size < n)
+		current++;
+
+	if (current == chunks.size()) {
+		size_t size = n > CHUNK ? n : CHUNK;
+		char *data = (char*)malloc(size);
+		if (data == 0)
+			throw bad_alloc();
+		chunks.push_back({data, size});
+		oversized = oversized || size > CHUNK;
+		if (stats) {
+			stats->allocs++;
+			stats->allocBytes += size;
+		}
+	}
+	used = n;
+	return chunks[current].data;
+}
+
+void Scratch::Reset() {
+	current = 0;
+	used = 0;
+	if (!oversized)
+		return;
+
+	// chunks made for one huge string are not kept for the next statement
+	size_t kept = 0;
+	for (Chunk& c : chunks) {
+		if (c.size > CHUNK)
+			free(c.data);
+		else
+			chunks[kept++] = c;
+	}
+	chunks.resize(kept);
+	oversized = false;
+}
@@ -0,0 +1,50 @@
+/*
+ * scratch.h
+ */
+
+#ifndef SCRATCH_H_
+#define SCRATCH_H_
+
+#include <cstddef>
+#include <vector>
+
+// Scratch is a bump allocator for the strings an expression builds on
+// its way to a result.  Each thread has one; Let and Print reset it when
+// they finish, after copying anything they keep.  The chunks are reused
+// from statement to statement, so a string expression costs no malloc
+// once the arena has warmed up.
+class Scratch {
+	struct Chunk {
+		char	*data;
+		size_t	size;
+	};
+
+	std::vector<Chunk>	chunks;
+	size_t	current;	// index of the chunk being filled
+	size_t	used;		// bytes used in that chunk
+	bool	oversized;	// a chunk larger than CHUNK was added
+
+	static const size_t CHUNK = 64 * 1024;
+
+	char *Grow(size_t n);
+
+public:
+	Scratch() : current(0), used(0), oversized(false) {}
+	~Scratch();
+
+	char *Alloc(size_t n) {
+		if (current < chunks.size() && n <= chunks[current].size - used) {
+			char *p = chunks[current].data + used;
+			used += n;
+			return p;
+		}
+		return Grow(n);
+	}
+
+	// frees everything allocated since the last Reset
+	void Reset();
+};
+
+extern thread_local Scratch scratch;
+
+#endif /* SCRATCH_H_ */
@@ -0,0 +1,280 @@
+/*
+ * server.cpp
+ */
+
+#include "server.h"
+#include "parse.h"
+#include "sched.h"
+#include "check.h"
+#include "binding.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#endif
+using namespace std;
+
+ScriptServer::ScriptServer(const Budget& limits, const SnapshotRef& base)
+		: limits(limits), base(base), hits(0), misses(0), runs(0), nextLatency(0) {}
+
+ScriptServer::~ScriptServer() {}
+
+// Modification time of a file in nanoseconds, where the platform has them
+static long long ModTime(const struct stat& st) {
+#if defined(__linux__)
+	return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+	return st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+	return st.st_mtime * 1000000000LL;
+#endif
+}
+
+// Returns the program for path checked with the variables in bound, from
+// the cache unless the file has changed since it was parsed
+shared_ptr<const ScriptServer::Program> ScriptServer::Lookup(const string& path, const vector<string>& bound,
+		string& reply) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		reply = "COULD NOT OPEN " + path + "\n";
+		return 0;
+	}
+
+	// the check marks the tree, so each set of bound names has a tree of its own
+	string names;
+	for (const string& id : bound)
+		names += id + ",";
+
+	{
+		lock_guard<mutex> l(lock);
+		File& f = cache[path];
+		if (f.mtime != ModTime(st) || f.size != st.st_size) {
+			f.mtime = ModTime(st);
+			f.size = st.st_size;
+			f.checked.clear();
+		}
+		auto it = f.checked.find(names);
+		if (it != f.checked.end()) {
+			hits++;
+			return it->second;
+		}
+		misses++;
+	}
+
+	// parsed without the lock, so that other connections carry on
+	ifstream in(path);
+	if (!in.is_open()) {
+		reply = "COULD NOT OPEN " + path + "\n";
+		return 0;
+	}
+	shared_ptr<Program> p = make_shared<Program>();
+	vector<SyntaxError> syntaxErrors;
+	int lineNumber = 0;
+	p->prog = Prog(in, lineNumber, syntaxErrors);
+	ostringstream errors;
+	for (const SyntaxError& e : syntaxErrors)
+		errors << e << endl;
+	if (p->prog != 0) {
+		for (const Diagnostic& d : CheckAssignments(p->prog, bound, base.get()))
+			errors << d << endl;
+	}
+	p->errors = errors.str();
+	if (!p->errors.empty()) {
+		delete p->prog;
+		p->prog = 0;
+	}
+
+	// keeps the first of two connections that parsed it at once
+	lock_guard<mutex> l(lock);
+	File& f = cache[path];
+	if (f.mtime == ModTime(st) && f.size == st.st_size)
+		return f.checked.insert(make_pair(names, p)).first->second;
+	return p;
+}
+
+bool ScriptServer::Run(const vector<string>& words, string& reply) {
+	if (words.size() < 2) {
+		reply = "RUN needs a script path\n";
+		return false;
+	}
+
+	map<string,Val> bindings;
+	for (size_t i = 2; i < words.size(); i++) {
+		size_t eq = words[i].find('=');
+		Val v;
+		if (eq == string::npos || !IsIdentifier(words[i].substr(0, eq))
+				|| !ParseBinding(words[i].substr(eq + 1), v)) {
+			reply = "BAD BINDING " + words[i] + "\n";
+			return false;
+		}
+		bindings[words[i].substr(0, eq)] = v;
+	}
+
+	vector<string> bound;
+	for (auto& b : bindings)
+		bound.push_back(b.first);
+	shared_ptr<const Program> p = Lookup(words[1], bound, reply);
+	if (p == 0)
+		return false;
+	if (p->prog == 0) {
+		reply = p->errors;
+		return true;
+	}
+
+	Task t(p->prog, base);
+	t.limits = limits;
+	for (auto& b : bindings)
+		t.Bind(b.first, b.second);
+	while (!t.Run(chrono::milliseconds(100)))
+		;
+	reply = t.Output();
+	lock_guard<mutex> l(lock);
+	runs++;
+	return true;
+}
+
+void ScriptServer::Record(long long micros) {
+	lock_guard<mutex> l(lock);
+	if (latencies.size() < LATENCY_SAMPLES)
+		latencies.push_back(micros);
+	else
+		latencies[nextLatency] = micros;
+	nextLatency = (nextLatency + 1) % LATENCY_SAMPLES;
+}
+
+string ScriptServer::Stats() {
+	unique_lock<mutex> l(lock);
+	vector<long long> sorted(latencies);
+	long long hits = this->hits, misses = this->misses, runs = this->runs;
+	l.unlock();
+
+	sort(sorted.begin(), sorted.end());
+	long long p50 = 0, p99 = 0;
+	if (!sorted.empty()) {
+		// nearest-rank percentiles
+		p50 = sorted[(sorted.size() * 50 + 99) / 100 - 1];
+		p99 = sorted[(sorted.size() * 99 + 99) / 100 - 1];
+	}
+	ostringstream out;
+	out << "hits " << hits << "\n"
+		<< "misses " << misses << "\n"
+		<< "runs " << runs << "\n"
+		<< "p50_us " << p50 << "\n"
+		<< "p99_us " << p99 << "\n";
+	return out.str();
+}
+
+bool ScriptServer::Handle(const string& request, string& reply) {
+	vector<string> words;
+	if (!SplitWords(request, words)) {
+		reply = "UNTERMINATED STRING\n";
+		return false;
+	}
+	if (words.empty()) {
+		reply = "EMPTY REQUEST\n";
+		return false;
+	}
+	if (words[0] == "STATS") {
+		reply = Stats();
+		return true;
+	}
+	if (words[0] == "RUN") {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		bool ok = Run(words, reply);
+		Record(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count());
+		return ok;
+	}
+	reply = "UNKNOWN REQUEST " + words[0] + "\n";
+	return false;
+}
+
+#ifndef _WIN32
+
+static bool WriteAll(int fd, const string& data) {
+	size_t done = 0;
+	while (done < data.length()) {
+		ssize_t n = write(fd, data.data() + done, data.length() - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+bool ScriptServer::Serve(const string& socketPath) {
+	sockaddr_un addr;
+	if (socketPath.length() >= sizeof(addr.sun_path))
+		return false;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	socketPath.copy(addr.sun_path, socketPath.length());
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+		return false;
+	unlink(socketPath.c_str());
+	if (::bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 64) != 0) {
+		close(listener);
+		return false;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	// a connection may send any number of requests
+	while (true) {
+		int conn = accept(listener, 0, 0);
+		if (conn < 0) {
+			if (errno == EINTR)
+				continue;
+			close(listener);
+			return false;
+		}
+		thread(&ScriptServer::Converse, this, conn).detach();
+	}
+}
+
+// Answers the requests on one connection until the client hangs up
+void ScriptServer::Converse(int conn) {
+	string pending;
+	char buf[4096];
+	ssize_t n;
+	bool open = true;
+	while (open && ((n = read(conn, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR))) {
+		if (n < 0)
+			continue;
+		pending.append(buf, n);
+		size_t nl;
+		while (open && (nl = pending.find('\n')) != string::npos) {
+			string request = pending.substr(0, nl);
+			pending.erase(0, nl + 1);
+			if (!request.empty() && request[request.length() - 1] == '\r')
+				request.erase(request.length() - 1);
+
+			string reply;
+			bool ok = Handle(request, reply);
+			open = WriteAll(conn, (ok ? "OK " : "ERR ") + to_string(reply.length()) + "\n" + reply);
+		}
+	}
+	close(conn);
+}
+
+#else
+
+// Unix domain sockets are not available to this build on Windows
+bool ScriptServer::Serve(const string& socketPath) {
+	return false;
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * server.h
+ */
+
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "parsetree.h"
+#include "budget.h"
+#include "symtab.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+using std::string;
+using std::vector;
+using std::map;
+
+// ScriptServer listens on a Unix domain socket and runs scripts on request,
+// keeping every parsed program in memory until its file changes.
+//
+// Each request is one line and each reply is "OK <n>" or "ERR <n>"
+// followed by a newline and exactly n bytes:
+//
+//	RUN <path> [name=value ...]	run a script with initial bindings; the
+//					reply holds its output, including any
+//					syntax, declaration or runtime errors
+//	STATS				cache hits, misses, runs and latencies
+//
+// Every run starts from the same frozen prelude variables, if the server
+// was given any, and its lets never change them.
+//
+// Each connection is served on a thread of its own, so a slow or idle
+// client holds up nobody else.  A parsed program is never changed once it
+// is in the cache, and connections running it share it.
+//
+// A value is an integer or a double-quoted string with \" \\ and \n escapes.
+class ScriptServer {
+	// a file parsed and checked for one set of bound names
+	struct Program {
+		ParseTree			*prog;		// null if the file has syntax or declaration errors
+		string				errors;		// those errors, as a run would print them
+
+		Program() : prog(0) {}
+		~Program() { delete prog; }
+	};
+
+	struct File {
+		long long			mtime;
+		long long			size;
+		map<string, std::shared_ptr<const Program>>	checked;	// by sorted binding names
+
+		File() : mtime(-1), size(-1) {}
+	};
+
+	std::mutex			lock;		// guards the cache and the counters
+	map<string,File>	cache;
+	Budget				limits;
+	SnapshotRef			base;		// the variables every run starts with, if any
+
+	long long			hits;
+	long long			misses;
+	long long			runs;
+	vector<long long>	latencies;	// microseconds, most recent runs only
+	size_t				nextLatency;
+
+	static const size_t LATENCY_SAMPLES = 4096;
+
+	std::shared_ptr<const Program> Lookup(const string& path, const vector<string>& bound, string& reply);
+	bool Handle(const string& request, string& reply);
+	bool Run(const vector<string>& words, string& reply);
+	string Stats();
+	void Record(long long micros);
+	void Converse(int conn);
+
+public:
+	ScriptServer(const Budget& limits, const SnapshotRef& base = SnapshotRef());
+	~ScriptServer();
+
+	// serves requests until the process is killed; false if the socket could not be set up
+	bool Serve(const string& socketPath);
+};
+
+#endif /* SERVER_H_ */
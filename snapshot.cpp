@@ -0,0 +1,219 @@
+/*
+ * snapshot.cpp
+ */
+
+#include "snapshot.h"
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+namespace {
+
+// The variables of a finished run, held in memory
+class FrozenSymbols : public Snapshot {
+	map<string,Val>	vars;
+	SnapshotRef		base;
+
+public:
+	FrozenSymbols(const SymbolTable& symbols) : base(symbols.Base()) {
+		for (auto& v : symbols.Local())
+			vars[v.first] = v.second.Own();
+	}
+
+	bool Get(const string& id, Val& v) const {
+		map<string,Val>::const_iterator it = vars.find(id);
+		if (it != vars.end()) {
+			v = Val::Borrow(it->second);
+			return true;
+		}
+		return base && base->Get(id, v);
+	}
+
+	void Collect(map<string,Val>& out) const {
+		for (auto& v : vars)
+			out.insert(v);
+		if (base)
+			base->Collect(out);
+	}
+};
+
+const char MAGIC[8] = { 'L', 'A', 'N', 'G', 'S', 'N', 'P', '1' };
+
+struct Entry {
+	uint64_t	nameOff;
+	uint64_t	nameLen;
+	uint64_t	kind;
+	uint64_t	value;
+	uint64_t	valueLen;
+};
+
+const uint64_t INT_KIND = 0;
+const uint64_t STR_KIND = 1;
+const size_t HEADER = sizeof(MAGIC) + sizeof(uint64_t);
+
+// A snapshot file mapped into memory.  Entries are checked against the
+// size of the file when they are looked at, not when the file is opened.
+class MappedSnapshot : public Snapshot {
+	const char		*data;
+	size_t			size;
+	const Entry		*entries;
+	uint64_t		count;
+#ifdef _WIN32
+	vector<char>	buffer;
+#endif
+
+	bool InFile(uint64_t off, uint64_t len) const {
+		return off <= size && len <= size - off;
+	}
+
+	// the value of entry e; false if the entry points outside the file
+	bool Value(const Entry& e, Val& v) const {
+		if (e.kind == INT_KIND) {
+			v = Val((int)(int64_t)e.value);
+			return true;
+		}
+		if (e.kind != STR_KIND || !InFile(e.value, e.valueLen))
+			return false;
+		v = Val::Borrow(data + e.value, e.valueLen);
+		return true;
+	}
+
+public:
+	MappedSnapshot() : data(0), size(0), entries(0), count(0) {}
+
+	~MappedSnapshot() {
+#ifndef _WIN32
+		if (data)
+			munmap((void*)data, size);
+#endif
+	}
+
+	bool Open(const string& path);
+
+	bool Get(const string& id, Val& v) const {
+		uint64_t lo = 0, hi = count;
+		while (lo < hi) {
+			uint64_t mid = lo + (hi - lo) / 2;
+			const Entry& e = entries[mid];
+			if (!InFile(e.nameOff, e.nameLen))
+				return false;
+			int cmp = memcmp(data + e.nameOff, id.data(), min<uint64_t>(e.nameLen, id.length()));
+			if (cmp == 0 && e.nameLen != id.length())
+				cmp = e.nameLen < id.length() ? -1 : 1;
+			if (cmp == 0)
+				return Value(e, v);
+			if (cmp < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return false;
+	}
+
+	void Collect(map<string,Val>& out) const {
+		for (uint64_t i = 0; i < count; i++) {
+			const Entry& e = entries[i];
+			Val v;
+			if (InFile(e.nameOff, e.nameLen) && Value(e, v))
+				out.insert(make_pair(string(data + e.nameOff, e.nameLen), v.Own()));
+		}
+	}
+};
+
+bool MappedSnapshot::Open(const string& path) {
+#ifndef _WIN32
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < HEADER) {
+		close(fd);
+		return false;
+	}
+	size = st.st_size;
+	void *mapped = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+		return false;
+	data = (const char*)mapped;
+#else
+	// no mmap here, so the file is read in whole
+	ifstream in(path, ios::binary);
+	if (!in.is_open())
+		return false;
+	buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	if (buffer.size() < HEADER)
+		return false;
+	data = buffer.data();
+	size = buffer.size();
+#endif
+
+	if (memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+		return false;
+	memcpy(&count, data + sizeof(MAGIC), sizeof(count));
+	if (count > (size - HEADER) / sizeof(Entry))
+		return false;
+	entries = (const Entry*)(data + HEADER);
+	return true;
+}
+
+} // namespace
+
+SnapshotRef Freeze(const SymbolTable& symbols) {
+	return SnapshotRef(new FrozenSymbols(symbols));
+}
+
+bool SaveSnapshot(const Snapshot& snap, const string& path) {
+	map<string,Val> vars;
+	snap.Collect(vars);
+
+	vector<Entry> entries;
+	string text;
+	uint64_t start = HEADER + vars.size() * sizeof(Entry);
+	for (auto& v : vars) {
+		Entry e;
+		e.nameOff = start + text.length();
+		e.nameLen = v.first.length();
+		text += v.first;
+		if (v.second.isInt()) {
+			e.kind = INT_KIND;
+			e.value = (uint64_t)(int64_t)v.second.ValInt();
+			e.valueLen = 0;
+		}
+		else {
+			e.kind = STR_KIND;
+			e.value = start + text.length();
+			e.valueLen = v.second.Length();
+			text.append(v.second.Data(), v.second.Length());
+		}
+		entries.push_back(e);
+	}
+
+	ofstream out(path, ios::binary | ios::trunc);
+	if (!out.is_open())
+		return false;
+	uint64_t count = entries.size();
+	out.write(MAGIC, sizeof(MAGIC));
+	out.write((const char*)&count, sizeof(count));
+	out.write((const char*)entries.data(), entries.size() * sizeof(Entry));
+	out.write(text.data(), text.length());
+	return (bool)out.flush();
+}
+
+SnapshotRef OpenSnapshot(const string& path) {
+	MappedSnapshot *snap = new MappedSnapshot;
+	if (!snap->Open(path)) {
+		delete snap;
+		return SnapshotRef();
+	}
+	return SnapshotRef(snap);
+}
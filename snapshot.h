@@ -0,0 +1,35 @@
+/*
+ * snapshot.h
+ */
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include "symtab.h"
+#include <string>
+using std::string;
+
+// Freezes the variables of a finished run.  Strings are copied out of
+// the program's pool, so the snapshot outlives the program that made it.
+extern SnapshotRef Freeze(const SymbolTable& symbols);
+
+// A snapshot file holds, in the byte order of the machine that wrote it:
+//
+//	"LANGSNP1"	magic
+//	count		number of variables, 8 bytes
+//	entries		count entries of five 8-byte fields, sorted by name:
+//			name offset, name length, kind (0 int, 1 string),
+//			the int or the string offset, string length
+//	text		the names and strings the entries point at
+//
+// Offsets are from the start of the file.  Opening one maps it into
+// memory and a lookup is a binary search of the entries, so neither
+// depends on how many variables the file holds.
+
+// writes every variable of snap to path; false if the file could not be written
+extern bool SaveSnapshot(const Snapshot& snap, const string& path);
+
+// maps a snapshot file; null if it cannot be read or is not a snapshot
+extern SnapshotRef OpenSnapshot(const string& path);
+
+#endif /* SNAPSHOT_H_ */
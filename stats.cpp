@@ -0,0 +1,83 @@
+/*
+ * stats.cpp
+ */
+
+#include "stats.h"
+#include "parsetree.h"
+#include <iomanip>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+using namespace std;
+
+thread_local Stats *stats = 0;
+
+static void CountNodes(const ParseTree *node, map<string,long long>& nodes) {
+	for (; node != 0; node = node->Right()) {
+		nodes[node->ClassName()]++;
+		CountNodes(node->Left(), nodes);
+	}
+}
+
+void Stats::Measure(const ParseTree *prog) {
+	CountNodes(prog, nodes);
+	depth = prog->MaxDepth();
+	bangs = prog->BangCount();
+}
+
+// Peak resident set size of the process in kilobytes, or 0 where it is not available
+static long long PeakRssKb() {
+#if defined(_WIN32)
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#if defined(__APPLE__)
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
+
+void Stats::Print(ostream& out, bool json) const {
+	const Phase *phases[] = { &lex, &parse, &check, &run };
+	const char *names[] = { "lex", "parse", "check", "run" };
+	long long totalNodes = 0;
+	for (auto& n : nodes)
+		totalNodes += n.second;
+
+	out << fixed << setprecision(3);
+	if (json) {
+		out << "{\"phases\":{";
+		for (int i = 0; i < 4; i++)
+			out << (i ? "," : "") << "\"" << names[i] << "\":{\"wall_ms\":" << phases[i]->wallMs
+				<< ",\"cpu_ms\":" << phases[i]->cpuMs << "}";
+		out << "},\"tokens\":" << tokens << ",\"nodes\":" << totalNodes << ",\"nodes_by_class\":{";
+		bool first = true;
+		for (auto& n : nodes) {
+			out << (first ? "" : ",") << "\"" << n.first << "\":" << n.second;
+			first = false;
+		}
+		out << "},\"depth\":" << depth << ",\"bangs\":" << bangs << ",\"symbols\":" << symbols
+			<< ",\"peak_rss_kb\":" << PeakRssKb() << ",\"val_allocs\":" << allocs
+			<< ",\"val_alloc_bytes\":" << allocBytes << "}" << endl;
+		return;
+	}
+
+	for (int i = 0; i < 4; i++)
+		out << names[i] << "_wall_ms " << phases[i]->wallMs << "\n"
+			<< names[i] << "_cpu_ms " << phases[i]->cpuMs << "\n";
+	out << "tokens " << tokens << "\n"
+		<< "nodes " << totalNodes << "\n";
+	for (auto& n : nodes)
+		out << "nodes_" << n.first << " " << n.second << "\n";
+	out << "depth " << depth << "\n"
+		<< "bangs " << bangs << "\n"
+		<< "symbols " << symbols << "\n"
+		<< "peak_rss_kb " << PeakRssKb() << "\n"
+		<< "val_allocs " << allocs << "\n"
+		<< "val_alloc_bytes " << allocBytes << endl;
+}
@@ -0,0 +1,76 @@
+/*
+ * stats.h
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <string>
+#include <map>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+using std::string;
+using std::map;
+using std::ostream;
+
+class ParseTree;
+
+// Stats collects what --stats reports about one run of a program: time
+// spent in each phase, the size and shape of the tree, and the heap
+// allocations made by Val operators.  The work of a --prelude is not
+// counted; it is not part of the program.  Collection is off, and costs one
+// test of a null pointer, unless stats points at a Stats.
+class Stats {
+public:
+	struct Phase {
+		double	wallMs;
+		double	cpuMs;
+		Phase() : wallMs(0), cpuMs(0) {}
+	};
+
+	Phase	lex, parse, check, run;
+	long long	tokens;
+	map<string,long long>	nodes;		// node count by class
+	int		depth;
+	int		bangs;
+	size_t	symbols;
+	long long	allocs;
+	long long	allocBytes;
+
+	Stats() : tokens(0), depth(0), bangs(0), symbols(0), allocs(0), allocBytes(0) {}
+
+	// records the shape of a parsed program
+	void Measure(const ParseTree *prog);
+
+	void Print(ostream& out, bool json) const;
+};
+
+// the Stats being collected by this thread, or null
+extern thread_local Stats *stats;
+
+// PhaseTimer adds the wall and CPU time of its lifetime to a Phase
+class PhaseTimer {
+	Stats::Phase&	phase;
+	std::chrono::steady_clock::time_point	wall;
+	std::clock_t	cpu;
+public:
+	PhaseTimer(Stats::Phase& phase) : phase(phase), wall(std::chrono::steady_clock::now()), cpu(std::clock()) {}
+	~PhaseTimer() {
+		phase.wallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall).count();
+		phase.cpuMs += 1000.0 * (std::clock() - cpu) / CLOCKS_PER_SEC;
+	}
+};
+
+// allocation hook for Val operators: counts a string's buffer if it is on the heap
+inline void CountAlloc(const string& s) {
+	if (stats == 0)
+		return;
+	static const size_t inlineCapacity = string().capacity();
+	if (s.capacity() > inlineCapacity) {
+		stats->allocs++;
+		stats->allocBytes += s.capacity() + 1;
+	}
+}
+
+#endif /* STATS_H_ */
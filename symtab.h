@@ -0,0 +1,101 @@
+/*
+ * symtab.h
+ */
+
+#ifndef SYMTAB_H_
+#define SYMTAB_H_
+
+#include "val.h"
+#include <string>
+#include <map>
+#include <memory>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+using std::string;
+using std::map;
+using std::vector;
+
+// A Snapshot is a frozen symbol table, such as the variables left behind
+// by a prelude script.  It never changes once made, so any number of
+// runs on any number of threads can share one.
+class Snapshot {
+public:
+	virtual ~Snapshot() {}
+
+	// sets v to the value of id; false if the snapshot does not hold it
+	virtual bool Get(const string& id, Val& v) const = 0;
+
+	// adds every variable to vars that is not there already
+	virtual void Collect(map<string,Val>& vars) const = 0;
+};
+
+typedef std::shared_ptr<const Snapshot> SnapshotRef;
+
+// The variables of one run.  A run may start from a Snapshot: reads fall
+// through to it, and a let writes to this table only, so the snapshot is
+// never copied and never changed.
+//
+// When asked to, the table also keeps track of which variables have been
+// set since it was last asked, so a checkpoint only has to write those.
+class SymbolTable {
+public:
+	typedef map<string,Val>::value_type Entry;
+
+private:
+	map<string,Val>		vars;
+	SnapshotRef			base;
+	bool				tracking;
+	std::unordered_set<const Entry*>	changed;
+
+public:
+	SymbolTable(const SnapshotRef& base = SnapshotRef()) : base(base), tracking(false) {}
+
+	// sets v to a view of the value of id; false if id has not been let
+	bool Get(const string& id, Val& v) const {
+		map<string,Val>::const_iterator it = vars.find(id);
+		if (it != vars.end()) {
+			v = Val::Borrow(it->second);
+			return true;
+		}
+		return base && base->Get(id, v);
+	}
+
+	// a view of the value of id, which the caller knows has been let
+	Val At(const string& id) const {
+		map<string,Val>::const_iterator it = vars.find(id);
+		if (it != vars.end())
+			return Val::Borrow(it->second);
+		Val v;
+		if (base)
+			base->Get(id, v);
+		return v;
+	}
+
+	void Set(const string& id, const Val& v) {
+		map<string,Val>::iterator it = vars.lower_bound(id);
+		if (it == vars.end() || it->first != id)
+			it = vars.emplace_hint(it, id, v);
+		else
+			it->second = v;
+		if (tracking)
+			changed.insert(&*it);
+	}
+
+	// starts keeping track of the variables that are set
+	void TrackChanges() { tracking = true; }
+
+	// the variables set since the last call, in name order
+	vector<const Entry*> TakeChanges() {
+		vector<const Entry*> entries(changed.begin(), changed.end());
+		changed.clear();
+		sort(entries.begin(), entries.end(), [](const Entry *a, const Entry *b) { return a->first < b->first; });
+		return entries;
+	}
+
+	// the variables set by this run, not counting the snapshot
+	const map<string,Val>& Local() const { return vars; }
+	const SnapshotRef& Base() const { return base; }
+};
+
+#endif /* SYMTAB_H_ */
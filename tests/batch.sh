@@ -0,0 +1,120 @@
+#
+# batch.sh: --batch runs a program over rows of bindings, and each row
+# prints what the program prints when run alone with that row's values
+#
+
+. tests/lib.sh
+
+program rows.col 'x 1 2 3 0 4 7
+s "a" "bb" "c" "d" "e" "f"
+'
+# scalar PROGRAM: the output of running PROGRAM once per row of rows.col,
+# each run starting with lets of that row's values, as the records of
+# --batch: "ROW index length", the output, then a newline
+scalar() {
+	i=0
+	for row in '1 "a"' '2 "bb"' '3 "c"' '0 "d"' '4 "e"' '7 "f"'; do
+		set -- $row
+		printf 'let x = %s; let s = %s; %s' "$1" "$2" "$(cat "$WORK/$program")" > "$WORK/row.txt"
+		(cd "$WORK" && "$LANGBIN" row.txt > row.out 2>&1)
+		printf 'ROW %d %d\n' $i $(wc -c < "$WORK/row.out")
+		cat "$WORK/row.out"
+		echo
+		i=$((i + 1))
+	done
+}
+
+# same PROGRAM ARGS...: checks --batch against scalar runs
+same() {
+	program=$1
+	shift
+	expect "$(scalar)" --batch=rows.col "$@" "$program"
+}
+
+# rows that take different paths through if and loop
+program paths.txt 'let y = x; let t = 0; if x begin let t = 100 / x; end; loop y begin let s = s + "."; let y = y - 1; end; print s + "|"; print t; print ";";
+'
+same paths.txt
+same paths.txt --batch-size=1
+same paths.txt --batch-size=4
+
+# rows that stop with an error while the others go on
+program fails.txt 'print x / (x - 2); print ";"; print s - 1; print "never";
+'
+same fails.txt
+
+# a variable is read in place; a let of it afterwards must not change what was read
+program reads.txt 'let a = x; let b = s; let x = x * 10; let s = "z"; let x = x + a; print a; print b; print x; print s; print "/";
+'
+same reads.txt
+same reads.txt --batch-size=5
+
+# a variable only some rows have set
+program some.txt 'if x - 2 begin let u = s + s; end; print x; print u; print ",";
+'
+same some.txt
+
+# a let of a variable to itself, in some rows
+program self.txt 'if x - 2 begin let x = x; let s = s; end; print x; print s;
+'
+same self.txt
+
+# the int kernels at the edges: more rows than one block of lanes, negative
+# operands, a result that wraps, and the one quotient that overflows
+program edge.col 'x -2147483648 7 -7 0 1000000003 -120 12 9 5 2147483647
+y -1 2 -2 0 -3 7 -1 1 -5 -1
+z -1 2 -2 3 -3 7 -1 1 -5 -1
+'
+program edge.txt 'print !x; print ","; print x * y; print ","; print x - y; print ","; print x / z; print ","; print x / y; print ";";
+'
+expect 'ROW 0 58
+126087180,-2147483648,-2147483647,-2147483648,-2147483648;
+ROW 1 11
+7,14,5,3,3;
+ROW 2 13
+-7,14,-5,3,3;
+ROW 3 49
+0,0,0,0,RUNTIME ERROR at 0: Divide by zero error
+
+ROW 4 56
+-1294967295,1294967287,1000000006,-333333334,-333333334;
+ROW 5 22
+-21,-840,-127,-17,-17;
+ROW 6 18
+21,-12,13,-12,-12;
+ROW 7 10
+9,9,8,9,9;
+ROW 8 15
+5,-25,10,-1,-1;
+ROW 9 60
+-1126087180,-2147483647,-2147483648,-2147483647,-2147483647;' --batch=edge.col edge.txt
+
+# every row has a record, one that printed nothing included, and a row's
+# output can hold newlines and look like a record of its own
+program rec.col 'x 1 3 2 4
+s "a\nROW 9 1\n" "\n" "bb" "c"
+'
+program rec.txt 'if x - 2 begin print s; end;
+'
+expect 'ROW 0 10
+a
+ROW 9 1
+
+ROW 1 1
+
+
+ROW 2 0
+
+ROW 3 1
+c' --batch=rec.col --batch-size=3 rec.txt
+
+program bad.col 'x 1 2
+y 3
+'
+expect 'BAD COLUMNS FILE bad.col line 2: y has 1 rows, not 2' --batch=bad.col paths.txt
+expect 'COULD NOT OPEN none.col' --batch=none.col paths.txt
+program undeclared.txt 'print z;
+'
+expect 'UNDECLARED VARIABLE z' --batch=rows.col undeclared.txt
+
+finish
@@ -0,0 +1,49 @@
+#
+# budget.sh: --fuel, --max-string and --timeout
+#
+
+. tests/lib.sh
+
+program loop.txt 'let n = 0; loop 1 begin let n = n + 1; end;
+'
+expect 'RUNTIME ERROR at 0: Instruction limit exceeded' --fuel=100 loop.txt
+expect 'RUNTIME ERROR at 0: Time limit exceeded' --timeout=50 loop.txt
+
+program count.txt 'let n = 3; loop n begin print n; let n = n - 1; end;
+'
+expect '321' --fuel=100 count.txt
+
+program repeat.txt 'print "ab" * 3;
+'
+expect 'ababab' --max-string=6 repeat.txt
+expect 'RUNTIME ERROR at 0: String length limit exceeded' --max-string=5 repeat.txt
+
+program concat.txt 'print "abc" + "def";
+'
+expect 'RUNTIME ERROR at 0: String length limit exceeded' --max-string=5 concat.txt
+
+# repeating costs fuel per copy, and nothing at all when there is nothing to copy
+program empty.txt 'let s = "" * 2000000000; let t = "x" * 0; print "ok";
+'
+expect 'ok' --fuel=10 empty.txt
+program big.txt 'let s = "a" * 100000; print "ok";
+'
+expect 'RUNTIME ERROR at 0: Instruction limit exceeded' --fuel=1000 big.txt
+expect 'ok' --fuel=200000 big.txt
+
+# the timeout covers the run, not the prelude and loading before it, on
+# every path; the prelude and each program take about half the timeout
+program slow.txt 'let n = 8000000; loop n begin let n = n - 1; end; let ready = 1;
+'
+program mid.txt 'let m = 8000000; loop m begin let m = m - 1; end; print "ran";
+'
+program midbatch.txt 'let m = 4000000; loop m begin let m = m - 1; end; print "ran";
+'
+program row.col 'x 1
+'
+expect 'ran' --timeout=1500 --prelude=slow.txt mid.txt
+expect 'ran' --timeout=1500 --prelude=slow.txt --workers=1 mid.txt
+expect 'ROW 0 3
+ran' --timeout=1500 --prelude=slow.txt --batch=row.col midbatch.txt
+
+finish
@@ -0,0 +1,38 @@
+#
+# check.sh: every variable must be let before it is used
+#
+
+. tests/lib.sh
+
+# reads that no earlier let assigns are reported, in source order, and
+# nothing runs
+program undeclared.txt 'print 1;
+print x;
+let x = 1;
+print y + z;
+'
+expect 'UNDECLARED VARIABLE x
+UNDECLARED VARIABLE y
+UNDECLARED VARIABLE z' undeclared.txt
+
+# a let in a body that may not run passes the check, and the read fails
+# at run time if it did not
+program maybe.txt 'if 0 begin let x = 1; end;
+print x;
+'
+expect 'RUNTIME ERROR at 1: Variable x is used before it is assigned' maybe.txt
+program taken.txt 'if 1 begin let x = 1; end;
+print x;
+'
+expect '1' taken.txt
+
+program loop.txt 'let n = 2; loop n begin let n = n - 1; let y = 7; end; print y;
+'
+expect '7' loop.txt
+
+# a let later in the program does not count for an earlier read in a loop
+program later.txt 'let n = 1; loop n begin print k; let n = 0; end; let k = 1;
+'
+expect 'UNDECLARED VARIABLE k' later.txt
+
+finish
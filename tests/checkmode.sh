@@ -0,0 +1,73 @@
+#
+# checkmode.sh: --check parses and checks many files without running them
+#
+
+. tests/lib.sh
+
+program good.txt 'let x = 1;
+print x;
+'
+# parsing goes on after each syntax error, and declaration errors are
+# reported alongside them in line order
+program bad.txt 'print 1
+let y = ;
+print y;
+if 1 begin print 2 end;
+print q;
+'
+program bad2.txt 'print z;
+let a = (1;
+print a + b;
+'
+report='bad.txt:2: Slist Error: Missing "SC" after "Stmt"
+bad.txt:3: UNDECLARED VARIABLE y
+bad.txt:4: Slist Error: Missing "SC" after "Stmt"
+bad.txt:4: IfStmt Error: Missing "Slist" after "IF Expr BEGIN"
+bad.txt:5: UNDECLARED VARIABLE q
+bad2.txt:1: UNDECLARED VARIABLE z
+bad2.txt:2: Primary Error: Missing "RPAREN" after "Expr"
+bad2.txt:2: Rev Error: "Rev" expected
+bad2.txt:2: Prod Error: "Rev" expected
+bad2.txt:2: Expr Error: "Prod" expected
+bad2.txt:2: LetStmt Error: Missing "Expr" after "LET ID"
+bad2.txt:3: UNDECLARED VARIABLE a
+bad2.txt:3: UNDECLARED VARIABLE b
+missing.txt: COULD NOT OPEN
+CHECKED 4 FILES, 3 WITH ERRORS'
+expect "$report" --check good.txt bad.txt bad2.txt missing.txt
+expect "$report" --check --workers=3 good.txt bad.txt bad2.txt missing.txt
+expect 'CHECKED 1 FILES, 0 WITH ERRORS' --check good.txt
+
+# the exit status says whether any file has an error; nothing is run
+(cd "$WORK" && "$LANGBIN" --check good.txt > /dev/null)
+check "--check: failed on a good file" [ $? -eq 0 ]
+(cd "$WORK" && "$LANGBIN" --check good.txt bad.txt > /dev/null)
+check "--check: passed a bad file" [ $? -eq 1 ]
+
+# the first error is the one a run reports, with its line counted from 1
+expect '1: Slist Error: Missing "SC" after "Stmt"
+1: Prog Error: No "Slist"' bad.txt
+
+# the report is in argument order whatever the number of threads
+files=
+for i in $(seq 1 40); do
+	case $((i % 3)) in
+	0)	program f$i.txt "let v$i = $i; print v$i;
+" ;;
+	1)	program f$i.txt "print u$i;
+let w = ($i;
+" ;;
+	*)	program f$i.txt "loop $i begin print $i end;
+" ;;
+	esac
+	files="$files f$i.txt"
+done
+one=$(cd "$WORK" && "$LANGBIN" --check --workers=1 $files)
+for n in 2 4 8; do
+	check "--check: --workers=$n differs" [ "$(cd "$WORK" && "$LANGBIN" --check --workers=$n $files)" = "$one" ]
+done
+check "--check: count" sh -c 'echo "$1" | tail -1 | grep -qx "CHECKED 40 FILES, 27 WITH ERRORS"' - "$one"
+
+expect '--check ONLY PARSES AND CHECKS FILES' --check --serve=lang.sock
+
+finish
@@ -0,0 +1,38 @@
+#
+# checkpoint.sh: --checkpoint and --resume give the output of an uninterrupted run
+#
+
+. tests/lib.sh
+
+program count.txt 'let i = 30; let total = 0;
+loop i begin let j = 100000; loop j begin let total = total + j / 1000; let j = j - 1; end; print i; print ","; let i = i - 1; end;
+print total;
+'
+want='30,29,28,27,26,25,24,23,22,21,20,19,18,17,16,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,148503000'
+expect "$want" count.txt
+expect "$want" --checkpoint=plain.ck --checkpoint-interval=0 count.txt
+
+# killed part way, then resumed with its output appended to the same file;
+# resuming a run that had already finished adds nothing
+"$LANGBIN" --checkpoint="$WORK/count.ck" --checkpoint-interval=20 "$WORK/count.txt" > "$WORK/out" &
+sleep 0.3
+kill -9 $! 2>/dev/null
+wait
+(cd "$WORK" && "$LANGBIN" --checkpoint=count.ck --resume count.txt >> out)
+check "--resume: output differs" [ "$(cat "$WORK/out")" = "$want" ]
+(cd "$WORK" && "$LANGBIN" --checkpoint=count.ck --resume count.txt >> out)
+check "--resume: finished run wrote more" [ "$(cat "$WORK/out")" = "$want" ]
+
+# a checkpoint only resumes the program it was written for
+program other.txt 'print 1;
+'
+expect 'COULD NOT RESUME FROM count.ck' --checkpoint=count.ck --resume other.txt
+expect 'COULD NOT RESUME FROM none.ck' --checkpoint=none.ck --resume count.txt
+expect '--resume NEEDS --checkpoint' --resume count.txt
+expect '--checkpoint ONLY WORKS ON A SINGLE PROGRAM' --checkpoint=count.ck --workers=2 count.txt
+
+# the timeout counts from when the program starts running
+out=$(cd "$WORK" && "$LANGBIN" --timeout=100 --checkpoint=timeout.ck count.txt 2>&1)
+check "--timeout with --checkpoint: $out" sh -c 'echo "$1" | grep -q "RUNTIME ERROR at 1: Time limit exceeded$"' - "$out"
+
+finish
@@ -0,0 +1,172 @@
+/*
+ * document_test.cpp
+ *
+ * Makes random edits to random programs and checks after each one that
+ * a Document gives what parsing and checking the whole text gives.
+ */
+
+#include "document.h"
+#include "parse.h"
+#include <sstream>
+#include <random>
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { cerr << __FILE__ << ":" << __LINE__ << ": " #cond << endl; failures++; } } while (0)
+
+static mt19937 rng(1);
+
+// the shape of a tree, with each identifier marked by whether the check
+// found it assigned on every path: only then does it read an empty table
+// without an error
+static void Dump(ParseTree *t, ostream& out) {
+	if (t == 0) {
+		out << "_";
+		return;
+	}
+	out << "(" << t->ClassName() << "@" << t->GetLineNumber();
+	if (t->IsIdent() || t->IsLet())
+		out << ":" << t->GetId();
+	if (t->IsIdent()) {
+		SymbolTable empty;
+		out << (t->Eval(empty).isErr() ? "?" : "!");
+	}
+	out << " ";
+	Dump(t->Left(), out);
+	out << " ";
+	Dump(t->Right(), out);
+	out << ")";
+}
+
+static void Describe(ParseTree *prog, const string& errors, const vector<Diagnostic>& diags, ostream& out) {
+	out << "errors [" << errors << "]";
+	if (prog == 0)
+		return;
+	for (const Diagnostic& d : diags)
+		out << d << ";";
+	Dump(prog, out);
+}
+
+static string Full(const string& text, const vector<string>& bound) {
+	istringstream in(text);
+	int line = 0;
+	vector<SyntaxError> errors;
+	ParseTree *prog = Prog(in, line, errors);
+	ostringstream messages, out;
+	for (const SyntaxError& e : errors)
+		messages << e << endl;
+	vector<Diagnostic> diags;
+	if (prog != 0)
+		diags = CheckAssignments(prog, bound);
+	Describe(prog, messages.str(), diags, out);
+	delete prog;
+	return out.str();
+}
+
+static string Incremental(const Document& doc) {
+	ostringstream out;
+	Describe(doc.Tree(), doc.Errors(), doc.Diagnostics(), out);
+	return out.str();
+}
+
+static string Var() {
+	const char *names[] = { "x", "y", "z", "w" };
+	return names[rng() % 4];
+}
+
+static string Expr(int depth) {
+	switch (rng() % (depth > 2 ? 3 : 6)) {
+	case 0:		return Var();
+	case 1:		return to_string(rng() % 50);
+	case 2:		return "\"s\"";
+	case 3:		return Expr(depth + 1) + " + " + Expr(depth + 1);
+	case 4:		return "(" + Expr(depth + 1) + ") * " + Expr(depth + 1);
+	default:	return "!" + Expr(depth + 1);
+	}
+}
+
+static string Stmt(int depth) {
+	string space = rng() % 3 ? " " : "\n";
+	string body;
+	switch (rng() % (depth > 1 ? 2 : 4)) {
+	case 0:
+		return "let " + Var() + " = " + Expr(0) + ";" + space;
+	case 1:
+		return "print " + Expr(0) + ";" + space;
+	case 2:
+		for (int i = rng() % 3; i >= 0; i--)
+			body += Stmt(depth + 1);
+		return "if " + Expr(0) + " begin" + space + body + "end;" + space;
+	default:
+		for (int i = rng() % 3; i >= 0; i--)
+			body += Stmt(depth + 1);
+		return "loop " + Expr(0) + " begin " + body + "end;" + space;
+	}
+}
+
+int main() {
+	// fragments that break statements apart, join them, or do not lex
+	const char *pieces[] = { "let ", "x", "y", "z", " = ", "1", "23", "\"s\"", "\"a\\\"b\"", ";", ";", "\n", " ",
+		"print ", "if ", "loop ", "begin ", "end", "+", "-", "*", "/", "!", "(", ")", "@", "// c\n", "\"open\n" };
+	const char *small[] = { " ", "\n", "x", "w", "1", "// c\n", "7" };
+	const size_t npieces = sizeof(pieces) / sizeof(*pieces);
+	vector<string> bound = { "z" };
+
+	int edits = 0, parsed = 0, wrong = 0;
+	for (int n = 0; n < 150; n++) {
+		string text;
+		for (int i = rng() % 12; i > 0; i--)
+			text += Stmt(0);
+		Document doc(text, bound);
+		CHECK(Incremental(doc) == Full(text, bound));
+
+		for (int e = 0; e < 40; e++) {
+			// mostly whole statements, often at a statement boundary
+			string inserted;
+			int kind = rng() % 10;
+			if (kind < 6)
+				inserted = Stmt(0);
+			else if (kind < 9)
+				inserted = small[rng() % 7];
+			else
+				for (int i = rng() % 3; i > 0; i--)
+					inserted += pieces[rng() % npieces];
+			size_t offset = text.empty() ? 0 : rng() % (text.length() + 1);
+			if (kind < 6 && rng() % 4) {
+				vector<size_t> cuts(1, 0);
+				for (size_t i = 0; i < text.length(); i++)
+					if (text[i] == ';' || text[i] == '\n')
+						cuts.push_back(i + 1);
+				offset = cuts[rng() % cuts.size()];
+			}
+			size_t removed = (rng() % 6 == 0 && offset < text.length())
+					? rng() % min<size_t>(text.length() - offset + 1, 8) : 0;
+
+			string before = text.substr(offset, removed);
+			bool had = doc.Tree() != 0;
+			doc.Edit(offset, removed, inserted);
+			text.replace(offset, removed, inserted);
+
+			// an edit that breaks the program is mostly undone, as an
+			// editor's user would, so most edits are to a program that parses
+			if (had && doc.Tree() == 0 && rng() % 16) {
+				doc.Edit(offset, inserted.length(), before);
+				text.replace(offset, inserted.length(), before);
+			}
+
+			edits++;
+			if (doc.Tree() != 0)
+				parsed++;
+			if (doc.Text() != text || Incremental(doc) != Full(text, bound)) {
+				if (wrong++ == 0)
+					cerr << "after an edit at " << offset << " of " << removed << " bytes to:\n" << text << "\n"
+						<< "incremental: " << Incremental(doc) << "\nfull:        " << Full(text, bound) << endl;
+			}
+		}
+	}
+	CHECK(wrong == 0);
+	// the random edits must leave most programs parsed, or little is being tested
+	CHECK(parsed > edits / 2);
+	return failures ? 1 : 0;
+}
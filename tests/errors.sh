@@ -0,0 +1,56 @@
+#
+# errors.sh: runtime errors carried in Val and reported with their line
+#
+
+. tests/lib.sh
+
+program plus.txt 'print 1 + "a";
+'
+expect 'RUNTIME ERROR at 0: Type mismatch on operands of +' plus.txt
+
+program minus.txt 'print 1;
+print 2 - "a";
+'
+expect '1RUNTIME ERROR at 1: Type mismatch on operands of -' minus.txt
+
+program divide.txt 'print "a" / 2;
+'
+expect 'RUNTIME ERROR at 0: Type mismatch on operands of /' divide.txt
+
+program zero.txt 'print 1; print 1 / 0; print 2;
+'
+expect '1RUNTIME ERROR at 0: Divide by zero error' zero.txt
+
+program negative.txt 'print (0 - 2) * "a";
+'
+expect 'RUNTIME ERROR at 0: Negative number multiplied by string' negative.txt
+program negative2.txt 'print "a" * (0 - 2);
+'
+expect 'RUNTIME ERROR at 0: Cannot multiply string by negative int' negative2.txt
+
+program if.txt 'if "x" begin print 1; end;
+'
+expect 'RUNTIME ERROR at 0: Expression is not an integer' if.txt
+
+program loop.txt 'loop "x" begin print 1; end;
+'
+expect 'RUNTIME ERROR at 0: LoopStmt expression evaluates to string type' loop.txt
+
+program unset.txt 'if 0 begin let x = 1; end;
+print x;
+'
+expect 'RUNTIME ERROR at 1: Variable x is used before it is assigned' unset.txt
+
+# the first error inside an expression is the one reported, and nothing after it runs
+program inner.txt 'print !("a" * 2 - 1);
+'
+expect 'RUNTIME ERROR at 0: Type mismatch on operands of -' inner.txt
+program let.txt 'let s = "ab" + 1; print 5;
+'
+expect 'RUNTIME ERROR at 0: Type mismatch on operands of +' let.txt
+
+program fine.txt 'print 6 / 2 + 1;
+'
+expect '4' fine.txt
+
+finish
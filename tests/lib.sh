@@ -0,0 +1,41 @@
+#
+# lib.sh
+#
+# Helpers for the test scripts: each writes programs with program, checks
+# what lang prints with expect, and ends with finish.
+
+failures=0
+
+# program NAME TEXT: writes TEXT to $WORK/NAME
+program() {
+	printf '%s' "$2" > "$WORK/$1"
+}
+
+# expect WANT ARGS...: runs lang with ARGS in $WORK and checks that it
+# prints WANT, standard error included
+expect() {
+	want=$1
+	shift
+	got=$(cd "$WORK" && "$LANGBIN" "$@" 2>&1)
+	if [ "$got" != "$want" ]; then
+		echo "lang $*"
+		echo "  expected: $want"
+		echo "  got:      $got"
+		failures=$((failures + 1))
+	fi
+}
+
+# check DESCRIPTION COMMAND...: checks that COMMAND succeeds
+check() {
+	desc=$1
+	shift
+	if ! "$@"; then
+		echo "$desc"
+		failures=$((failures + 1))
+	fi
+}
+
+finish() {
+	rm -rf "$WORK"
+	[ $failures -eq 0 ]
+}
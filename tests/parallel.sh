@@ -0,0 +1,47 @@
+#
+# parallel.sh: --parallel evaluates runs of lets concurrently
+#
+
+. tests/lib.sh
+
+# lets that read, write or rewrite each other's variables still see the
+# values sequential execution gives them
+program deps.txt 'let a = 1; let b = 2; let c = a + b; let a = c * 10; let d = a + b + c;
+print a; print b; print c; print d;
+'
+expect '302335' deps.txt
+expect '302335' --parallel=2 deps.txt
+expect '302335' --parallel=4 deps.txt
+
+program strings.txt 'let a = "ab" * 3; let b = !a; let c = !123; print b; print c;
+'
+expect 'bababa321' --parallel=3 strings.txt
+
+# the error reported is the first one in statement order
+program errors.txt 'let a = 1; let b = a / 0; let c = "x" + 1; print a;
+'
+expect 'RUNTIME ERROR at 0: Divide by zero error' --parallel=4 errors.txt
+program errors2.txt 'let a = 1; let c = "x" + 1; let b = a / 0; print a;
+'
+expect 'RUNTIME ERROR at 0: Type mismatch on operands of +' --parallel=4 errors2.txt
+
+# a run of lets inside a loop body
+program loop.txt 'let n = 3; let s = 0; loop n begin let s = s + n; let t = n * n; let n = n - 1; end; print s;
+'
+expect '6' --parallel=2 loop.txt
+
+# lets in one wave that repeat strings under --fuel fail where a
+# sequential run does, however the wave's work is split among threads
+program fuel.txt 'let a = "x" * 500;
+let b = "y" * 300;
+let c = "z" * 200;
+print 1;
+'
+for n in 1 3; do
+	expect 'RUNTIME ERROR at 0: Instruction limit exceeded' --parallel=$n --fuel=400 fuel.txt
+	expect 'RUNTIME ERROR at 2: Instruction limit exceeded' --parallel=$n --fuel=850 fuel.txt
+	expect 'RUNTIME ERROR at 3: Instruction limit exceeded' --parallel=$n --fuel=1003 fuel.txt
+	expect '1' --parallel=$n --fuel=1004 fuel.txt
+done
+
+finish
@@ -0,0 +1,76 @@
+/*
+ * pool_test.cpp
+ *
+ * Checks that a program's literals and identifiers are interned once and
+ * that evaluating string literals allocates nothing.
+ */
+
+#include "parse.h"
+#include "budget.h"
+#include "stats.h"
+#include <sstream>
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { cerr << __FILE__ << ":" << __LINE__ << ": " #cond << endl; failures++; } } while (0)
+
+static void Collect(ParseTree *t, const string& cls, vector<ParseTree*>& found) {
+	if (t == 0)
+		return;
+	if (cls == t->ClassName())
+		found.push_back(t);
+	Collect(t->Left(), cls, found);
+	Collect(t->Right(), cls, found);
+}
+
+static ParseTree *Parse(const string& text) {
+	istringstream in(text);
+	int line = 0;
+	return Prog(in, line);
+}
+
+int main() {
+	ConstPool pool;
+	CHECK(pool.Intern("abc") == pool.Intern(string("ab") + "c"));
+	CHECK(pool.Intern("abc") != pool.Intern("abd"));
+	CHECK(pool.Size() == 2);
+
+	ParseTree *prog = Parse("let greeting = \"a literal too long for the inline buffer\";\n"
+			"let n = 100;\n"
+			"loop n begin let greeting = \"a literal too long for the inline buffer\"; let n = n - 1; end;\n"
+			"let copy = greeting;\n");
+	CHECK(prog != 0);
+
+	// every copy of a literal evaluates to the same text
+	vector<ParseTree*> literals;
+	Collect(prog, "SConst", literals);
+	CHECK(literals.size() == 2);
+	SymbolTable symbols;
+	Val first = literals[0]->Eval(symbols), second = literals[1]->Eval(symbols);
+	CHECK(first.Data() == second.Data());
+	CHECK(first.Keep().Data() == first.Data());
+
+	// two mentions are the same variable exactly when their pointers are equal
+	vector<ParseTree*> idents;
+	Collect(prog, "Ident", idents);
+	CHECK(idents.size() == 3);
+	for (ParseTree *a : idents)
+		for (ParseTree *b : idents)
+			CHECK((a->GetId() == b->GetId()) == (static_cast<Ident*>(a)->GetIdRef() == static_cast<Ident*>(b)->GetIdRef()));
+
+	// running the loop stores the literal a hundred times without copying it
+	Budget limits;
+	budget = &limits;
+	Stats counted;
+	stats = &counted;
+	Val result = prog->Eval(symbols);
+	stats = 0;
+	CHECK(!result.isErr());
+	CHECK(counted.allocs == 0);
+	Val copy;
+	CHECK(symbols.Get("copy", copy) && copy.Data() == first.Data());
+
+	delete prog;
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+#!/bin/sh
+#
+# run.sh
+#
+# Builds the interpreter and runs every test.  A tests/*.sh script runs
+# lang, whose path is in $LANGBIN, and says what it expected; a
+# tests/*_test.cpp is built against the interpreter's sources, without
+# main.cpp, and passes if it exits with 0.
+#
+#   sh tests/run.sh [test ...]
+#
+# Set CXX to pick the compiler and BUILD to keep the build directory.
+
+cd "$(dirname "$0")/.." || exit 1
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--std=c++14 -Wall -O2 -pthread}
+if [ -z "$BUILD" ]; then
+	BUILD=$(mktemp -d)
+	trap 'rm -rf "$BUILD"' EXIT
+fi
+mkdir -p "$BUILD/obj"
+
+for src in *.cpp; do
+	$CXX $CXXFLAGS -c -o "$BUILD/obj/${src%.cpp}.o" "$src" || exit 1
+done
+$CXX $CXXFLAGS -o "$BUILD/lang" "$BUILD"/obj/*.o || exit 1
+LIBOBJS=$(ls "$BUILD"/obj/*.o | grep -v '/main\.o$')
+
+if [ $# -gt 0 ]; then
+	TESTS="$*"
+else
+	TESTS=$(ls tests/*.sh tests/*_test.cpp | grep -v '/run\.sh$\|/lib\.sh$')
+fi
+
+failed=0
+for t in $TESTS; do
+	name=$(basename "$t")
+	case "$t" in
+	*.cpp)
+		exe="$BUILD/${name%.cpp}"
+		if $CXX $CXXFLAGS -iquote . -o "$exe" "$t" $LIBOBJS && "$exe"; then
+			echo "PASS $name"
+		else
+			echo "FAIL $name"
+			failed=$((failed + 1))
+		fi
+		;;
+	*)
+		if LANGBIN="$BUILD/lang" WORK=$(mktemp -d) sh "$t"; then
+			echo "PASS $name"
+		else
+			echo "FAIL $name"
+			failed=$((failed + 1))
+		fi
+		;;
+	esac
+done
+
+echo "$failed FAILED"
+[ $failed -eq 0 ]
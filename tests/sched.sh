@@ -0,0 +1,31 @@
+#
+# sched.sh: --workers runs many programs on the scheduler
+#
+
+. tests/lib.sh
+
+program a.txt 'let n = 0; loop 1000 - n begin let n = n + 1; end; print "a"; print n;
+'
+program b.txt 'print "b";
+'
+program c.txt 'let n = 3; loop n begin print n; let n = n - 1; end;
+'
+program bad.txt 'print x;
+'
+
+# output comes out in argument order whatever order the tasks finish in
+expect 'a1000b321' --workers=1 a.txt b.txt c.txt
+expect 'a1000b321' --workers=3 --quantum=1 a.txt b.txt c.txt
+expect 'bRUNTIME ERROR at 0: Instruction limit exceeded
+321' --workers=2 --fuel=100 b.txt a.txt c.txt
+expect 'UNDECLARED VARIABLE x
+COULD NOT OPEN missing.txt
+b' --workers=2 bad.txt missing.txt b.txt
+
+# the timeout is per task: one that waits for a worker gets its full time
+program spin.txt 'loop 1 begin let n = 1; end;
+'
+expect 'RUNTIME ERROR at 0: Time limit exceeded
+b' --workers=1 --quantum=100000000 --timeout=200 spin.txt b.txt
+
+finish
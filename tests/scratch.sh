@@ -0,0 +1,31 @@
+#
+# scratch.sh: string results built in the scratch arena and kept past their statement
+#
+
+. tests/lib.sh
+
+# rep TEXT N: TEXT repeated N times
+rep() {
+	awk -v s="$1" -v n="$2" 'BEGIN { for (i = 0; i < n; i++) printf "%s", s }'
+}
+
+program nested.txt 'let a = "ab"; let b = (a + "c") * 2 + !a; print b; let c = b; print c;
+'
+expect 'abcabcbaabcabcba' nested.txt
+
+program print.txt 'print !("ab" * 2) + "-" + !"xyz";
+'
+expect 'baba-zyx' print.txt
+
+# a variable let from its own old value, many statements after the arena was reset
+program loop.txt 'let s = "abc"; let n = 3; loop n begin let s = s + !s; let n = n - 1; end; print s;
+'
+expect 'abccbaabccbaabccbaabccba' loop.txt
+
+# results larger than an arena chunk, built from other results that are too
+program big.txt 'let s = "abc" * 25000; let t = !(s + "d"); print t; print "|"; print s * 2;
+'
+expect "d$(rep cba 25000)|$(rep abc 50000)" big.txt
+expect "d$(rep cba 25000)|$(rep abc 50000)" --parallel=2 big.txt
+
+finish
@@ -0,0 +1,120 @@
+/*
+ * server_test.cpp
+ *
+ * Runs a ScriptServer on a socket in a temporary directory and talks to
+ * it from several clients at once.
+ */
+
+#include "server.h"
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { cerr << __FILE__ << ":" << __LINE__ << ": " #cond << endl; failures++; } } while (0)
+
+static string socketPath;
+
+static int Connect() {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	socketPath.copy(addr.sun_path, socketPath.length());
+	for (int tries = 0; tries < 500; tries++) {
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0)
+			return fd;
+		close(fd);
+		usleep(10000);
+	}
+	return -1;
+}
+
+// Sends one request and reads its reply, giving up after two seconds
+static string Ask(int fd, const string& request) {
+	string line = request + "\n";
+	if (write(fd, line.data(), line.length()) != (ssize_t)line.length())
+		return "WRITE FAILED";
+	string got;
+	char buf[4096];
+	while (true) {
+		size_t nl = got.find('\n');
+		if (nl != string::npos) {
+			size_t n = atoi(got.c_str() + got.find(' ') + 1);
+			if (got.length() >= nl + 1 + n)
+				return got;
+		}
+		pollfd p = { fd, POLLIN, 0 };
+		if (poll(&p, 1, 2000) <= 0)
+			return "TIMED OUT";
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n <= 0)
+			return "CLOSED";
+		got.append(buf, n);
+	}
+}
+
+int main() {
+	char dir[] = "/tmp/servertestXXXXXX";
+	if (mkdtemp(dir) == 0)
+		return 1;
+	socketPath = string(dir) + "/s.sock";
+	string script = string(dir) + "/double.txt";
+	ofstream(script) << "print x * 2;\n";
+	string bad = string(dir) + "/bad.txt";
+	ofstream(bad) << "print y;\n";
+
+	// never destroyed: Serve only returns on failure
+	ScriptServer *server = new ScriptServer(Budget());
+	thread([server] { server->Serve(socketPath); }).detach();
+
+	// a client that connects and then says nothing holds up nobody
+	int idle = Connect();
+	CHECK(idle >= 0);
+	int busy = Connect();
+	CHECK(busy >= 0);
+	CHECK(Ask(busy, "RUN " + script + " x=21") == "OK 2\n42");
+	CHECK(Ask(idle, "RUN " + script + " x=5") == "OK 2\n10");
+	CHECK(Ask(busy, "RUN " + bad) == "OK 22\nUNDECLARED VARIABLE y\n");
+	CHECK(Ask(busy, "RUN " + bad + " y=1") == "OK 1\n1");
+	CHECK(Ask(busy, "FOO") == "ERR 20\nUNKNOWN REQUEST FOO\n");
+
+	// many clients running the same program at once
+	atomic<int> wrong(0);
+	vector<thread> clients;
+	for (int c = 0; c < 8; c++) {
+		clients.emplace_back([&, c] {
+			int fd = Connect();
+			for (int i = 0; i < 50; i++) {
+				string want = to_string((c * 100 + i) * 2);
+				if (Ask(fd, "RUN " + script + " x=" + to_string(c * 100 + i))
+						!= "OK " + to_string(want.length()) + "\n" + want)
+					wrong++;
+			}
+			close(fd);
+		});
+	}
+	for (thread& t : clients)
+		t.join();
+	CHECK(wrong == 0);
+
+	string stats = Ask(idle, "STATS");
+	CHECK(stats.find("runs 403\n") != string::npos);
+	CHECK(stats.find("misses 3\n") != string::npos);
+
+	close(idle);
+	close(busy);
+	unlink(socketPath.c_str());
+	unlink(script.c_str());
+	unlink(bad.c_str());
+	rmdir(dir);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,43 @@
+#
+# snapshot.sh: runs that start from a prelude or a saved snapshot
+#
+
+. tests/lib.sh
+
+program pre.txt 'let greeting = "hello"; let n = 3;
+'
+# reads n from the prelude first, and from the run's own table once it is let
+program use.txt 'loop n begin print greeting; let n = n - 1; end; print n;
+'
+expect 'hellohellohello0' --prelude=pre.txt use.txt
+expect 'UNDECLARED VARIABLE n
+UNDECLARED VARIABLE greeting
+UNDECLARED VARIABLE n' use.txt
+
+# a saved snapshot gives the same run as the prelude it came from
+expect '' --prelude=pre.txt --save-snapshot=pre.snap
+check "--save-snapshot: no file" [ -s "$WORK/pre.snap" ]
+expect 'hellohellohello0' --snapshot=pre.snap use.txt
+
+# a prelude adds to a snapshot
+program more.txt 'let greeting = greeting + "!"; let m = n * 2;
+'
+program both.txt 'print greeting; print m;
+'
+expect 'hello!6' --snapshot=pre.snap --prelude=more.txt both.txt
+
+# the lets of one run never reach the next
+program shadow.txt 'let greeting = "bye"; print greeting;
+'
+expect 'byehellohellohello0' --prelude=pre.txt --workers=2 shadow.txt use.txt
+
+expect 'COULD NOT OPEN SNAPSHOT none.snap' --snapshot=none.snap use.txt
+program bad.snap 'not a snapshot
+'
+expect 'COULD NOT OPEN SNAPSHOT bad.snap' --snapshot=bad.snap use.txt
+
+program fails.txt 'print 1 / 0;
+'
+expect 'RUNTIME ERROR at 0: Divide by zero error' --prelude=fails.txt use.txt
+
+finish
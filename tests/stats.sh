@@ -0,0 +1,55 @@
+#
+# stats.sh: --stats reports the shape of a program and what its run allocated
+#
+
+. tests/lib.sh
+
+# stats prints what lang writes to standard error for a run
+stats() {
+	(cd "$WORK" && "$LANGBIN" "$@" 2>&1 >/dev/null)
+}
+
+program shape.txt 'let a = "ab" * 30; let b = !a; print b;
+'
+out=$(stats --stats shape.txt)
+for line in 'tokens 15' 'nodes_Let 2' 'nodes_Print 1' 'nodes_TimesExpr 1' 'bangs 1' 'symbols 2'; do
+	check "--stats: no line '$line'" sh -c 'echo "$1" | grep -qx "$2"' - "$out" "$line"
+done
+for field in lex_wall_ms parse_cpu_ms check_wall_ms run_cpu_ms depth peak_rss_kb val_allocs val_alloc_bytes; do
+	check "--stats: no $field" sh -c 'echo "$1" | grep -q "^$2 "' - "$out" "$field"
+done
+
+json=$(stats --stats=json shape.txt)
+check "--stats=json: not one object" sh -c 'echo "$1" | grep -q "^{\"phases\":{\"lex\":.*}$"' - "$json"
+check "--stats=json: no node classes" sh -c 'echo "$1" | grep -q "\"nodes_by_class\":{[^}]*\"Let\":2"' - "$json"
+
+# a prelude is not counted, and the parse time does not lose its lexing twice
+program pre.txt "$(awk 'BEGIN { for (i = 0; i < 5000; i++) printf "let v%d = %d;\n", i, i }')
+let n = 20000; loop n begin let s = \"abc\" * 100; let n = n - 1; end;
+"
+out=$(stats --stats --prelude=pre.txt shape.txt)
+for line in 'tokens 15' 'nodes_Let 2' 'symbols 2'; do
+	check "--stats --prelude: no line '$line'" sh -c 'echo "$1" | grep -qx "$2"' - "$out" "$line"
+done
+check "--stats --prelude: counted the prelude's loop" sh -c '! echo "$1" | grep -q "^nodes_Loop "' - "$out"
+check "--stats --prelude: negative time" sh -c '! echo "$1" | grep -q "_ms -"' - "$out"
+check "--stats --prelude: counted prelude allocations" sh -c 'echo "$1" | grep -qx "val_allocs [0-9]"' - "$out"
+
+# lets run on --parallel workers count their allocations with the rest:
+# the string a, the arena chunk it is built in, and a copy for each of b, c and d
+program copies.txt 'let a = "ab" * 30; let b = a; let c = a; let d = a;
+'
+allocs() {
+	stats "$@" | grep '^val_allocs '
+}
+check "--stats: sequential allocations" [ "$(allocs --stats copies.txt)" = "val_allocs 5" ]
+for i in 1 2 3 4 5 6 7 8; do
+	check "--stats: parallel allocations" [ "$(allocs --stats --parallel=3 copies.txt)" = "val_allocs 5" ]
+done
+
+# the counters belong to a single run of a single program
+expect '--stats ONLY WORKS ON A SINGLE PROGRAM' --stats --workers=2 shape.txt
+expect '--stats ONLY WORKS ON A SINGLE PROGRAM' --stats --serve=lang.sock
+expect '--stats ONLY WORKS ON A SINGLE PROGRAM' --stats --check shape.txt
+
+finish
@@ -5,18 +5,110 @@
 #include <vector>
 #include <cmath>
 #include <iostream>
+#include "budget.h"
+#include "errcode.h"
+#include "stats.h"
+#include "scratch.h"
+#include <cstring>
 using namespace std;
 
+// the decimal digits of i in reverse order, keeping its sign; a result
+// too big for an int wraps around.  The loop runs once for each digit an
+// int can have, choosing with ?: rather than stopping early, so that batch
+// mode can take the same steps across many rows at once (see ReverseInts
+// in batch.cpp, which vectorizes).  This loop, on one int, does not.
+inline int ReverseDigits(int i) {
+    unsigned rev = 0;
+    for (int k = 0; k < 10; k++) {
+        rev = (i != 0) ? rev * 10 + (unsigned)(i % 10) : rev;
+        i /= 10;
+    }
+    return (int)rev;
+}
+
+// A Val is an int, a string, an error, or nothing (the result of a
+// statement).  An error holds an ErrCode and the line it was raised on;
+// an operator given an error operand returns that error unchanged, so an
+// error raised deep in an expression reaches the statement intact.
+//
+// A string Val either owns its text or is a view of text held elsewhere:
+// a literal in the program's ConstPool, a variable in the symbol table,
+// or an intermediate result in this thread's Scratch arena.  Operators
+// build their results in the arena, and only Keep() copies a string into
+// storage of its own, so an expression allocates nothing on the heap.
+// Pool views stay valid for the life of the program; every other view
+// only lasts until the end of the statement.
 class Val {
-    int i;
-    string s;
-    enum ValType { ISINT, ISSTR, ISERR } vt;
+    int i;                  // the int, or the ErrCode of an error
+    enum ValType { ISINT, ISSTR, ISERR, ISNONE } vt;
+    int line;               // line of an error, -1 until a node sets it
+    bool lasting;           // a view that outlives the statement
+    string s;               // the string, or the detail of an error
+    const char *p;          // the text of a view, null if s holds the string
+    size_t n;               // the length of a view
+
+    Val Mismatch(const Val& op, ErrCode code) const {
+        if (isErr()) return *this;
+        if (op.isErr()) return op;
+        return Val(code);
+    }
+
+    static Val View(const char *text, size_t len, bool lasting) {
+        Val v;
+        v.vt = ISSTR;
+        v.p = text;
+        v.n = len;
+        v.lasting = lasting;
+        return v;
+    }
+
+    // a string result of len bytes, written by fill into the scratch arena
+    template <class Fill>
+    static Val Build(size_t len, Fill fill) {
+        char *buf = scratch.Alloc(len);
+        fill(buf);
+        return View(buf, len, false);
+    }
 
 public:
-    Val() : i(0), vt(ISERR) {}
-    Val(int i) : i(i), vt(ISINT) {}
-    Val(string s) : i(0), s(s), vt(ISSTR) {}
-    Val(ValType vt, string errmsg) : i(0), s(errmsg), vt(ISERR) {}
+    Val() : i(0), vt(ISNONE), line(-1), lasting(false), p(0), n(0) {}
+    Val(int i) : i(i), vt(ISINT), line(-1), lasting(false), p(0), n(0) {}
+    Val(string s) : i(0), vt(ISSTR), line(-1), lasting(false), s(std::move(s)), p(0), n(0) {}
+    Val(ErrCode code) : i(code), vt(ISERR), line(-1), lasting(false), p(0), n(0) {}
+    Val(ErrCode code, const string& detail) : i(code), vt(ISERR), line(-1), lasting(false), s(detail), p(0), n(0) {}
+
+    // a view of text the caller keeps alive for the life of the program
+    static Val Ref(const string *text) {
+        return View(text->data(), text->length(), true);
+    }
+
+    // a view of v, which must not change before the statement ends
+    static Val Borrow(const Val& v) {
+        if (v.isStr() && v.p == 0)
+            return View(v.s.data(), v.s.length(), false);
+        return v;
+    }
+
+    // a view of text that must not change before the statement ends
+    static Val Borrow(const char *text, size_t len) {
+        return View(text, len, false);
+    }
+
+    // a Val that can outlive the statement: a short-lived view is copied
+    Val Keep() const {
+        if (!isStr() || p == 0 || lasting)
+            return *this;
+        string owned(p, n);
+        CountAlloc(owned);
+        return Val(std::move(owned));
+    }
+
+    // a Val that depends on nothing else, not even the program's pool
+    Val Own() const {
+        if (!isStr() || p == 0)
+            return *this;
+        return Val(string(p, n));
+    }
 
     ValType getVt() const { return vt; }
 
@@ -24,13 +116,23 @@ public:
     bool isInt() const { return vt == ISINT; }
     bool isStr() const { return vt == ISSTR; }
 
-    int ValInt() const {
-        if (isInt()) return i;
-        throw "This Val is not an Int";
+    // callers check the type first
+    int ValInt() const { return i; }
+    string ValString() const { return string(Data(), Length()); }
+    const char *Data() const { return p ? p : s.data(); }
+    size_t Length() const { return p ? n : s.length(); }
+
+    // records the line of an error unless a deeper node already has
+    Val& At(int l) {
+        if (line < 0) line = l;
+        return *this;
     }
-    string ValString() const {
-        if (isStr()) return s;
-        throw "This Val is not a Str";
+
+    ErrCode GetErrCode() const { return isErr() ? (ErrCode)i : ERR_NONE; }
+    int GetErrLine() const { return line; }
+    string GetErrMsg() const { return isErr() ? ErrText((ErrCode)i, s) : ""; }
+    string RuntimeError() const {
+        return "RUNTIME ERROR at " + to_string(line) + ": " + GetErrMsg();
     }
 
     friend ostream& operator<<(ostream& out, const Val& v) {
@@ -39,28 +141,30 @@ public:
     		return out;
     	}
     	else {
-    		out << v.s;
+    		out.write(v.Data(), v.Length());
     		return out;
     	}
     }
 
-    string GetErrMsg() const {
-        if (isErr()) return s;
-        throw "This Val is not an Error";
-    }
-
     Val operator+(const Val& op) const {
         if (isInt() && op.isInt())
             return ValInt() + op.ValInt();
-        if (isStr() && op.isStr())
-            return ValString() + op.ValString();
-        return Val(ISERR, "Type mismatch on operands of +");
+        if (isStr() && op.isStr()) {
+        	size_t a = Length(), b = op.Length();
+        	if (!budget->StringFits(a + b))
+        		return Val(ERR_STRING_LIMIT);
+        	return Build(a + b, [&](char *d) {
+        		memcpy(d, Data(), a);
+        		memcpy(d + a, op.Data(), b);
+        	});
+        }
+        return Mismatch(op, ERR_PLUS_TYPES);
     }
 
     Val operator-(const Val& op) const {
         if (isInt() && op.isInt())
             return ValInt() - op.ValInt();
-        return Val(ISERR, "Type mismatch on operands of -");
+        return Mismatch(op, ERR_MINUS_TYPES);
     }
 
     Val operator*(const Val& op) const {
@@ -68,58 +172,61 @@ public:
             return ValInt() * op.ValInt();
         if (isInt() && op.isStr()) {
         	if (ValInt() < 0)
-        		return Val(ISERR, "Negative number multiplied by string");
-        	string temp;
-        	for(int i = 0; i < ValInt(); i++) {
-        		temp += op.ValString();
-        	}
-        	return Val(temp);
+        		return Val(ERR_NEGATIVE_TIMES_STRING);
+        	return op.Repeat(ValInt());
         }
         if (isStr() && op.isInt()) {
         	if (op.ValInt() < 0)
-        		return Val(ISERR, "Cannot multiply string by negative int");
-        	string temp;
-        	for(int i = 0; i < op.ValInt(); i++) {
-        		temp += ValString();
-        	}
-        	return Val(temp);
+        		return Val(ERR_STRING_TIMES_NEGATIVE);
+        	return Repeat(op.ValInt());
         }
-        return Val(ISERR, "Type mismatch on operands of *");
+        return Mismatch(op, ERR_TIMES_TYPES);
+    }
+
+    // this string repeated count times; each copy costs one unit of fuel
+    Val Repeat(int count) const {
+    	size_t len = Length();
+    	if (len == 0 || count == 0)
+    		return Val(string());
+    	if (!budget->StringFits(len, count))
+    		return Val(ERR_STRING_LIMIT);
+    	if (!budget->Charge(count))
+    		return Val(budget->Reason());
+    	return Build(len * count, [&](char *d) {
+    		for(int i = 0; i < count; i++) {
+    			memcpy(d + i * len, Data(), len);
+    		}
+    	});
     }
 
     Val operator/(const Val& op) const {
-    	if (op.isInt()) {
+    	if (isInt() && op.isInt()) {
 			if (op.ValInt() == 0) {
-				return Val(ISERR, "Divide by zero error");
+				return Val(ERR_DIVIDE_BY_ZERO);
 			}
-    	}
-    	if (isInt())
+			// the one quotient too big for an int wraps around, as a product does
+			if (op.ValInt() == -1)
+				return (int)(0u - (unsigned)ValInt());
             return ValInt() / op.ValInt();
-        return Val(ISERR, "Type mismatch on operands of /");
+    	}
+    	if (isStr() && op.isInt() && op.ValInt() == 0)
+    		return Val(ERR_DIVIDE_BY_ZERO);
+        return Mismatch(op, ERR_DIVIDE_TYPES);
     }
 
     Val operator!() const {
-    	if (isInt()) {
-			vector<int> a;
-			int iRev = ValInt(), temp;
-			while (iRev != 0) {
-				temp = iRev % 10;
-				a.push_back(temp);
-				iRev /= 10;
-			}
-			for(int i = 0; (unsigned)i < a.size(); i++) {
-				iRev += a[i] * (pow(10, a.size() - i - 1));
-			}
-			return Val(iRev);
-		}
+    	if (isInt())
+    		return Val(ReverseDigits(ValInt()));
     	if (isStr()) {
-    		string temp;
-    		for (int i = s.length() - 1; i >= 0; i--) {
-    			temp += s[i];
-    		}
-    		return Val(temp);
+    		size_t len = Length();
+    		return Build(len, [&](char *d) {
+    			const char *src = Data();
+    			for (size_t i = 0; i < len; i++) {
+    				d[i] = src[len - 1 - i];
+    			}
+    		});
     	}
-    	return Val(ISERR, "Type mismatch on operands of !");
+    	return Mismatch(*this, ERR_BANG_TYPES);
     }
 };
 